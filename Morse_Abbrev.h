@@ -0,0 +1,171 @@
+/*
+   Abbreviations, Q codes and prosigns that stand in for common phrases,
+   to cut the time a message takes on the air (#abbrev on).
+
+   morseAbbrevs[] is the table. Edit it freely, keeping the phrases upper
+   case and in order; a static_assert checks the order. A phrase matches
+   text in any case, but only as whole words: at the start of a word and
+   followed by a space, punctuation or the end of the text queued so far.
+   Letters between < and > in a replacement are keyed run together as one
+   prosign, so "<AR>" goes out as .-.-. with no letter gap.
+
+   The sorted table is its own trie. The phrases that share the first k
+   characters of the text form one run of it, so matching narrows a
+   [first, last) range by binary search at each character, in a single
+   pass over the text and with no nodes stored. The longest phrase that
+   matches wins.
+*/
+
+#ifndef MORSE_ABBREV_H
+#define MORSE_ABBREV_H
+
+#include "Morse_HAL.h"
+#include "Morse_Table.h"
+
+struct MorseAbbrev {
+  char phrase[24];
+  char replacement[6];
+};
+
+constexpr MorseAbbrev morseAbbrevs[] PROGMEM = {
+  { "ABOUT", "ABT" },
+  { "AGAIN", "AGN" },
+  { "BEST REGARDS", "73" },
+  { "BREAK", "<BT>" },
+  { "END OF CONTACT", "<SK>" },
+  { "END OF MESSAGE", "<AR>" },
+  { "GOOD AFTERNOON", "GA" },
+  { "GOOD EVENING", "GE" },
+  { "GOOD MORNING", "GM" },
+  { "HERE", "HR" },
+  { "LOVE AND KISSES", "88" },
+  { "MESSAGE", "MSG" },
+  { "MY LOCATION IS", "QTH" },
+  { "NUMBER", "NR" },
+  { "OVER TO YOU", "<KN>" },
+  { "PLEASE", "PSE" },
+  { "PLEASE WAIT", "<AS>" },
+  { "RECEIVED", "RCVD" },
+  { "REPORT", "RPT" },
+  { "SIGNAL REPORT", "RST" },
+  { "THANK YOU", "TU" },
+  { "THANKS", "TNX" },
+  { "WEATHER", "WX" },
+  { "WHAT IS YOUR LOCATION", "QTH?" },
+  { "YOUR", "UR" }
+};
+
+const uint8_t morseAbbrevCount = sizeof(morseAbbrevs) / sizeof(morseAbbrevs[0]);
+const int morseNoAbbrev = -1;
+
+constexpr bool morseAbbrevLess(const char* a, const char* b) {
+  return *a != *b ? (uint8_t)*a < (uint8_t)*b : *a != '\0' && morseAbbrevLess(a + 1, b + 1);
+}
+
+constexpr bool morseAbbrevsSorted(uint8_t i = 1) {
+  return i >= morseAbbrevCount ||
+         (morseAbbrevLess(morseAbbrevs[i - 1].phrase, morseAbbrevs[i].phrase) && morseAbbrevsSorted(i + 1));
+}
+
+static_assert(morseAbbrevsSorted(), "morseAbbrevs[] must be in order of phrase");
+
+// Character k of phrase i, '\0' past its end
+inline char morseAbbrevChar(uint8_t i, uint8_t k) {
+  return k < sizeof(morseAbbrevs[i].phrase) ? pgm_read_byte(&morseAbbrevs[i].phrase[k]) : '\0';
+}
+
+// True for a character that may follow a phrase
+inline bool morseAbbrevBoundary(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '.' || c == ',' || c == '?' || c == '!';
+}
+
+// The longest phrase that text starts with, or morseNoAbbrev; length is
+// set to the number of characters it covers. The end of the text counts
+// as a boundary, and more is set if the text ran out while some phrase
+// could still match, so that more text might change the answer. Text is
+// anything with count() and peek(i), such as a CharRing.
+template <typename Text>
+int morseAbbrevMatch(const Text& text, uint8_t& length, bool& more) {
+  uint8_t first = 0, last = morseAbbrevCount;
+  int found = morseNoAbbrev;
+  uint8_t k = 0;
+  for (; k < text.count() && first < last; k++) {
+    char c = text.peek(k);
+    if (c >= 'a' && c <= 'z') {
+      c -= 'a' - 'A';
+    }
+    // Within the run, character k only ever rises, so the phrases with c
+    // there lie between two binary searches
+    uint8_t lo = first, hi = last;
+    while (lo < hi) {
+      uint8_t mid = (lo + hi) / 2;
+      if ((uint8_t)morseAbbrevChar(mid, k) < (uint8_t)c) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    first = lo;
+    hi = last;
+    while (lo < hi) {
+      uint8_t mid = (lo + hi) / 2;
+      if ((uint8_t)morseAbbrevChar(mid, k) <= (uint8_t)c) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    last = lo;
+    // A phrase that ends here sorts first in the run
+    if (first < last && morseAbbrevChar(first, k + 1) == '\0' &&
+        (k + 1U == text.count() || morseAbbrevBoundary(text.peek(k + 1)))) {
+      found = first;
+      length = k + 1;
+    }
+  }
+  more = k == text.count() && first < last;
+  return found;
+}
+
+// Packed code of the letter of replacement i at *at, or of the letters of
+// the prosign that starts there run together, and move at past it.
+// morseInvalid if there is none or a prosign runs over seven elements.
+inline uint8_t morseAbbrevCode(uint8_t i, uint8_t& at) {
+  char c = pgm_read_byte(&morseAbbrevs[i].replacement[at++]);
+  if (c != '<') {
+    return morseEncode(c);
+  }
+  uint16_t code = 1;
+  while ((c = pgm_read_byte(&morseAbbrevs[i].replacement[at])) != '\0') {
+    at++;
+    if (c == '>') {
+      break;
+    }
+    uint8_t letter = morseEncode(c);
+    uint8_t n = morseLength(letter);
+    code = (code << n) | (letter & ((1 << n) - 1));
+  }
+  return code > 0xFF ? morseInvalid : code;
+}
+
+// Units of air time phrase i takes, each letter with the letter gap after
+// it and each space stretching that to a word gap
+inline unsigned int morseAbbrevPhraseUnits(uint8_t i) {
+  unsigned int units = 0;
+  char c;
+  for (uint8_t k = 0; (c = morseAbbrevChar(i, k)) != '\0'; k++) {
+    units += c == ' ' ? 7 - 3 : morseUnits(morseEncode(c)) + 3;
+  }
+  return units;
+}
+
+// Units phrase i takes less than its replacement
+inline int morseAbbrevSaving(uint8_t i) {
+  unsigned int replacement = 0;
+  for (uint8_t at = 0; pgm_read_byte(&morseAbbrevs[i].replacement[at]) != '\0'; ) {
+    replacement += morseUnits(morseAbbrevCode(i, at)) + 3;
+  }
+  return (int)morseAbbrevPhraseUnits(i) - (int)replacement;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+   Compile-time feature selection for the sketch.
+
+   Set any of these before the first include, or pass -DMORSE_...=0 to the
+   compiler. A feature that is off is left out entirely: its objects are
+   not defined, so it takes no SRAM, and its code is either not compiled
+   or folded away behind a constant, so it takes no flash.
+
+     MORSE_LCD        16x2 LCD showing the text being sent
+     MORSE_BUZZER     Sine sidetone on pin 3, see Morse_Sidetone.h
+     MORSE_ERROR_LED  Error LED flashed for a character with no code
+     MORSE_ECHO       Prompts and messages on Serial, and received text
+                      echoed there in #rx mode
+     MORSE_RECEIVE    #rx, decoding a straight key on the key input pin
+     MORSE_PROTOCOL   The framed protocol of Morse_Protocol.h
+     MORSE_SLEEP      Idle sleep between passes of loop(), see Morse_Sleep.h
+     MORSE_ABBREV     #abbrev, keying common phrases as abbreviations,
+                      see Morse_Abbrev.h
+     MORSE_SLOTS      Messages saved in EEPROM for #play and #beacon, see
+                      Morse_Slots.h
+     MORSE_TRACE      Trace ring and latency histograms for #trace,
+                      about 370 bytes of RAM (off by default)
+     MORSE_CHANNELS   Number of keying channels, 1 to 3
+
+   The earlier revisions are configurations of the one sketch now; each
+   keeps the LED keying, the input queue and the # commands:
+
+     rev4  MORSE_RECEIVE=0 MORSE_PROTOCOL=0 MORSE_SLOTS=0 MORSE_ABBREV=0
+     rev3  as rev4 with MORSE_BUZZER=0
+     rev2  as rev3 with MORSE_LCD=0 MORSE_ERROR_LED=0
+
+   host/Morse_Footprint.sh builds these and others for the Uno and prints
+   the flash and SRAM each one uses.
+*/
+
+#ifndef MORSE_CONFIG_H
+#define MORSE_CONFIG_H
+
+#ifndef MORSE_LCD
+#define MORSE_LCD 1
+#endif
+
+#ifndef MORSE_BUZZER
+#define MORSE_BUZZER 1
+#endif
+
+#ifndef MORSE_ERROR_LED
+#define MORSE_ERROR_LED 1
+#endif
+
+#ifndef MORSE_ECHO
+#define MORSE_ECHO 1
+#endif
+
+#ifndef MORSE_RECEIVE
+#define MORSE_RECEIVE 1
+#endif
+
+#ifndef MORSE_PROTOCOL
+#define MORSE_PROTOCOL 1
+#endif
+
+#ifndef MORSE_SLEEP
+#define MORSE_SLEEP 1
+#endif
+
+#ifndef MORSE_SLOTS
+#define MORSE_SLOTS 1
+#endif
+
+#ifndef MORSE_ABBREV
+#define MORSE_ABBREV 1
+#endif
+
+#ifndef MORSE_TRACE
+#define MORSE_TRACE 0
+#endif
+
+#ifndef MORSE_CHANNELS
+#define MORSE_CHANNELS 1
+#endif
+
+#if MORSE_CHANNELS < 1 || MORSE_CHANNELS > 3
+#error "MORSE_CHANNELS must be 1, 2 or 3"
+#endif
+
+// The same switches as constants, for code that is always compiled but
+// skipped when a feature is off
+const bool morseLcd = MORSE_LCD;
+const bool morseBuzzer = MORSE_BUZZER;
+const bool morseErrorLed = MORSE_ERROR_LED;
+const bool morseEcho = MORSE_ECHO;
+
+#endif
@@ -1,147 +1,1366 @@
-#include <LiquidCrystal.h>
+// The LCD, buzzer, receive mode and the rest are chosen at compile time;
+// see Morse_Config.h
+#include "Morse_Config.h"
+#include "Morse_HAL.h"
+#include "Morse_Table.h"
+#include "Morse_Unicode.h"
+#include "Morse_RingBuffer.h"
+#include "Morse_Keyer.h"
+#include "Morse_Timing.h"
+#if MORSE_RECEIVE
+#include "Morse_Decoder.h"
+#include "Morse_KeyInput.h"
+#endif
+#include "Morse_LcdFrame.h"
+#if MORSE_ERROR_LED
+#include "Morse_ErrorLed.h"
+#endif
+#include "Morse_Trace.h"
+#if MORSE_SLEEP
+#include "Morse_Sleep.h"
+#endif
+#if MORSE_PROTOCOL
+#include "Morse_Protocol.h"
+#endif
+#if MORSE_SLOTS
+#include "Morse_Slots.h"
+#endif
+#if MORSE_ABBREV
+#include "Morse_Abbrev.h"
+#endif
 
-// Initialize the LCD library with the numbers of the interface pins
-LiquidCrystal lcd(12, 11, 5, 4, 3, 2);
+#if MORSE_LCD
+// Initialize the LCD library with the numbers of the interface pins.
+// D6 was on pin 3 until the sidetone took it over; wire it to A3 now.
+LiquidCrystal lcd(12, 11, 5, 4, A3, 2);
+
+// Everything is drawn here and reaches the LCD a few cells per pass of
+// loop(), so a display update never holds up reading Serial
+LcdFrame display(lcd);
+#else
+NullLcdFrame display;
+#endif
+const uint8_t lcdCommandsPerPass = 4;
 
 // Define LED Pins
 const int onboardLedPin = 13;
 const int morseLedPin = 9;  // Morse code output LED
 const int errorLedPin = 10;  // Error indication LED
-const int buzzerPin = 8;  // Buzzer output pin
+// The sidetone is on pin 3, see Morse_Sidetone.h. The buzzer that used to
+// hang off pin 8 is replaced by a speaker or piezo on pin 3.
+const int keyInputPin = 7;  // Straight key to ground, for receive mode
 
-int currentCursorPos = 0;
 int brightness = 100;  // Half brightness
-int time_delay = 750;
-String inputText = "";  // Store the user input
-
-void blinkMorse(char* code);
-
-// Define Morse code mappings
-char* morseCode[43] = {
-  ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---",
-  "-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.", "...", "-",
-  "..-", "...-", ".--", "-..-", "-.--", "--..",
-  "-----", ".----", "..---", "...--", "....-", ".....", "-....", "--...", "---..", "----.",
-  "--..--", ".-.-.-", "-.-.-", "---...", ".----.", ".-..-.", "-....-"
+
+const uint16_t newlineHold = 2000;  // Time to read the scrolled message
+
+// Each channel's characters wait to be keyed in its own queue. Serial is
+// drained into the selected channel's queue on every pass of loop() so the
+// 64 byte hardware RX buffer never overflows while keying. Above the high
+// watermark we send XOFF so the sender pauses, and once the keyer has
+// worked it down to the low watermark we send XON again. The margin above
+// the high mark covers bytes already on their way. Extra channels share
+// the RAM of the one queue a single channel would have.
+const unsigned int inputQueueSize = MORSE_CHANNELS == 1 ? 256 : 128;
+const unsigned int inputHighWater = inputQueueSize * 3 / 4;
+const unsigned int inputLowWater = inputQueueSize / 4;
+const unsigned long serialBaud = 115200;
+const char XON = 0x11;
+const char XOFF = 0x13;
+bool inputPaused = false;  // XOFF sent and not yet followed by XON
+
+// A line starting with '#' is a command for the sketch rather than text to
+// send. It is run as soon as its newline arrives, ahead of queued text.
+char commandLine[24];
+uint8_t commandLength = 0;
+bool inCommand = false;
+bool atLineStart = true;
+
+// Text arrives as UTF-8 and is queued as bytes of the current alphabet's
+// code page (see Morse_Table.h); #alpha picks the alphabet
+uint8_t alphabet = MORSE_LATIN;
+const char* const alphabetNames[morseAlphabets] = { "latin", "cyrillic", "greek", "wabun" };
+Utf8Decoder utf8;
+const char unknownChar = 0x1A;  // ASCII SUB, queued for characters the page lacks
+
+// A character with no code in the current alphabet never holds anything
+// up: it is counted and reported with its column, the error LED flashes in
+// the background, and #bad decides whether it is left out or a substitute
+// is keyed in its place
+enum InvalidPolicy : uint8_t { INVALID_SKIP, INVALID_SUBSTITUTE };
+uint8_t invalidPolicy = INVALID_SKIP;
+char invalidSubstitute = '?';
+const uint8_t errorFlashes = 5;
+
+#if MORSE_ERROR_LED
+ErrorFlasher errorFlasher(errorLedPin);
+#endif
+
+#if MORSE_LCD
+// The current line as shown on the second LCD row. Only the last 16
+// characters are kept; older ones scroll off the left edge.
+CharRing<16> inputText;
+#endif
+
+// A channel keys its own LED from its own text at its own speed and
+// pitch. The timer interrupt ticks every channel's keyer, so they all
+// run interleaved on the one 1 ms timebase. Channel 0 is the one shown on
+// the LCD; typed text, commands and frames go to the selected channel,
+// which #ch or FRAME_SET_CHANNEL changes.
+//
+// There is a single sidetone generator. Whichever channel keys down first
+// holds it for that mark, and a channel keying down meanwhile lights its
+// LED without sounding. Pin 6 is the only PWM pin left over, so
+// channel 2's LED on A1 is simply on at any brightness from 128 up.
+struct Channel {
+  explicit Channel(uint8_t ledPin) : keyer(ledPin), timing(morseTiming(12)), column(0) {
+#if MORSE_ABBREV
+    wordStart = true;
+    abbrev = morseNoAbbrev;
+    abbrevAt = 0;
+    unitsSaved = 0;
+#endif
+  }
+
+  Keyer keyer;  // The timer interrupt keys the LED and sidetone from its queue of elements
+  CharRing<inputQueueSize> queue;
+  MorseTiming timing;  // Derived from the speed and changed with #wpm and #fwpm
+  uint16_t column;  // Characters of the current line keyed so far, for error reports
+#if MORSE_ABBREV
+  bool wordStart;  // The next character starts a word, and so perhaps a phrase
+  int8_t abbrev;  // Replacement being keyed, or morseNoAbbrev
+  uint8_t abbrevAt;  // Position in it
+  unsigned int unitsSaved;  // By abbreviations in the current line
+#endif
+};
+
+Channel channels[MORSE_CHANNELS] = {
+  Channel(morseLedPin),
+#if MORSE_CHANNELS > 1
+  Channel(6),
+#endif
+#if MORSE_CHANNELS > 2
+  Channel(A1),
+#endif
 };
+Channel* input = &channels[0];  // The selected channel
+const uint8_t maxCharElements = 2 * 7 + 1;  // Seven marks and gaps, then the letter gap
+
+bool lineDone = false;  // Newline queued on channel 0; clear the LCD once it has been keyed
+
+// Characters keyed and characters with no code, on all channels, for
+// #status and FRAME_STATUS
+unsigned long charsSent = 0;
+unsigned int charErrors = 0;
+
+#if MORSE_PROTOCOL
+// A program can drive the sketch with the frames of Morse_Protocol.h on the
+// same line as typed text
+FrameReader frames;
+int lastTextSeq = -1;  // Seq of the text frame just queued, so a resend is not queued twice
+#endif
+
+#if MORSE_ABBREV
+// With #abbrev on, phrases at the front of a channel's queue are keyed as
+// the abbreviations of Morse_Abbrev.h, matched against the queued text
+// itself just before it is keyed. The units of air time saved are counted
+// per line, and reported at its end and by #status.
+//
+// A phrase can only be matched once enough of it is queued, so while the
+// text at the front could still turn out to be one, the channel holds off
+// for up to abbrevWaitMs after the last byte arrived.
+bool abbreviate = false;
+const unsigned long abbrevWaitMs = 20;
+unsigned long lastRxMs = 0;
+unsigned int lastUnitsSaved = 0;  // By the last line to finish, on any channel
+unsigned long totalUnitsSaved = 0;
+#endif
+
+#if MORSE_SLOTS
+// Messages kept in EEPROM, see Morse_Slots.h. #save queues saveMarker on
+// the selected channel, and the line that follows it is saved instead of
+// keyed once the channel's queue gets there, so text typed before the
+// command is still sent. #play keys a slot on the selected channel;
+// #beacon keys one on channel 0 again and again, a pause after channel 0
+// last fell idle, and is remembered in EEPROM so it starts at power-up.
+MessageSlots slots;
+const char saveMarker = 0x1E;  // ASCII RS; typed control characters never reach the queue
+Channel* saveChannel = NULL;  // Channel whose queue holds the marker
+bool saveStarted = false;  // The marker has been reached
+uint8_t saveSkipped = 0;  // Characters with no code left out of the save
+Channel* playChannel = NULL;  // Channel keying a slot
+int8_t beaconSlot = MessageSlots::noSlot;
+uint16_t beaconPauseS = 0;
+unsigned long beaconIdleSince = 0;
+#endif
+
+// Receive mode (#rx) decodes a key on keyInputPin instead of sending text.
+// The pin-change interrupt queues each edge as its micros() timestamp with
+// the level in bit 0 (1 = key down); micros() counts in 4us steps on a
+// 16 MHz board, so that bit is otherwise always clear.
+#if MORSE_RECEIVE
+SpscQueue<uint32_t, 32> keyEdges;
+MorseDecoder decoder;
+bool receiveMode = false;
+#else
+const bool receiveMode = false;
+#endif
+
+void runPass();
+void receiveByte(char c);
+void runCommand(const char* command);
+void updateFlowControl();
+void sendCharacter(Channel& channel, char c);
+void showInputChar(char c);
+void showPrompt(const char* prompt);
+void setSpeed(const char* wpm);
+void setFarnsworth(const char* wpm);
+void setAlphabet(const char* name);
+void setInvalidPolicy(const char* policy);
+void keyCode(Channel& channel, uint8_t code);
+#if MORSE_ABBREV
+enum AbbrevStart : uint8_t { ABBREV_NONE, ABBREV_STARTED, ABBREV_WAIT };
+AbbrevStart startAbbrev(Channel& channel);
+void sendAbbrevLetter(Channel& channel);
+void setAbbreviate(const char* on);
+#endif
+void selectChannel(const char* n);
+void queueText(char c);
+#if MORSE_RECEIVE
+void decodeKeyInput();
+void setReceiveMode(bool on, uint8_t wpm);
+#endif
+#if MORSE_PROTOCOL
+void handleFrame();
+void sendNak(uint8_t seq, uint8_t error);
+#endif
+#if MORSE_SLOTS
+void saveNextChar(Channel& channel);
+void playSlotLetter(Channel& channel);
+void startPlay(Channel& channel, uint8_t slot);
+void runBeacon();
+bool runSlotCommand(const char* command);
+#endif
 
 void setup() {
-  pinMode(buzzerPin, OUTPUT);
   pinMode(onboardLedPin, OUTPUT);
-  pinMode(morseLedPin, OUTPUT);
-  pinMode(errorLedPin, OUTPUT);
-  
   digitalWrite(onboardLedPin, LOW);
-  digitalWrite(errorLedPin, LOW);
-  
-  Serial.begin(9600);
-  Serial.println("Enter a word:");
-  
+  if (morseErrorLed) {
+    pinMode(errorLedPin, OUTPUT);
+    digitalWrite(errorLedPin, LOW);
+  }
+
+  for (uint8_t i = 0; i < MORSE_CHANNELS; i++) {
+    pinMode(channels[i].keyer.ledPin, OUTPUT);
+    channels[i].keyer.brightness = brightness;
+  }
+#if MORSE_BUZZER
+  sidetoneBegin();
+#endif
+  keyTimerBegin();
+#if MORSE_SLEEP
+  sleepBegin();
+#endif
+#if MORSE_RECEIVE
+  keyInputBegin(keyInputPin);
+#endif
+
+  Serial.begin(serialBaud);
+  if (morseEcho) {
+    Serial.println("Enter a word:");
+  }
+
+#if MORSE_LCD
   // Set up the LCD's number of columns and rows:
   lcd.begin(16, 2);
-  lcd.print("Enter a word:");
+#endif
+  display.begin();
+  display.print("Enter a word:");
+  display.flush();
+
+#if MORSE_SLOTS
+  beaconSlot = slots.beaconSlot();
+  beaconPauseS = slots.beaconPause();
+  beaconIdleSince = millis() - beaconPauseS * 1000UL;  // First message at once
+#endif
 }
 
-void handleError() {
-    Serial.println("Non-standard character detected, please try again");
-    lcd.clear();
-    lcd.print("Err Invalid Char");
-    for (int i = 0; i < 5; i++) {
-        analogWrite(errorLedPin, brightness);  // Turn error LED on
-        delay(100);  // 100ms on
-        analogWrite(errorLedPin, 0);   // Turn error LED off
-        delay(25);  // 25ms off
-    }
-    delay(time_delay);  // Gap after error message
-    lcd.clear();
-    currentCursorPos = 0;  // Reset cursor position
+void keyTimerTick() {
+  for (uint8_t i = 0; i < MORSE_CHANNELS; i++) {
+    channels[i].keyer.tick();
+  }
+#if MORSE_ERROR_LED
+  errorFlasher.tick();
+#endif
+}
+
+#if MORSE_RECEIVE
+void keyInputChange() {
+  bool down = digitalRead(keyInputPin) == LOW;
+  keyEdges.push((micros() & ~1UL) | (down ? 1 : 0));
+}
+#endif
+
+// True while the bytes from Serial are the middle of a frame
+bool readingFrame() {
+#if MORSE_PROTOCOL
+  return frames.active();
+#else
+  return false;
+#endif
+}
+
+// True if Serial has a byte and there is somewhere to put it. A frame is
+// read to its end whatever the queue holds; it is answered with a NAK if
+// its text does not fit.
+bool canReadSerial() {
+  return Serial.available() && (readingFrame() || input->queue.capacity() - input->queue.count() >= 2);  // Room for a voiced kana
 }
 
 void loop() {
-  if (Serial.available()) {
-    char c = Serial.read();
-    
-    if (c == ' ') { // Check if the input character is a space
-      inputText += ' ';
-      lcd.setCursor(0, 1);
-      if (inputText.length() <= 16) {
-        lcd.print(inputText);
-      } else {
-        lcd.print(inputText.substring(inputText.length() - 16));
+  runPass();
+
+#if MORSE_SLEEP
+  // Nothing more can be done until an interrupt brings a byte or moves a
+  // keyer on, so wait for one asleep rather than spinning
+  if (!canReadSerial() && !display.changed()) {
+    sleepIdle();
+  }
+#endif
+}
+
+// Move everything the UART has received into the queue, then hand the
+// next character to the keyer. Neither step waits, so this returns right
+// away while the timer interrupt does the keying.
+void runPass() {
+  MORSE_TRACE_SCOPE(STAGE_LOOP);
+
+  while (canReadSerial()) {
+    receiveByte(Serial.read());
+  }
+  updateFlowControl();
+#if MORSE_SLOTS
+  slots.pump();
+#endif
+  if (display.changed()) {
+    MORSE_TRACE_SCOPE(STAGE_LCD);
+    MORSE_TRACE_EVENT(TRACE_LCD_FLUSH, 0);
+    display.flush(lcdCommandsPerPass);
+  }
+
+#if MORSE_RECEIVE
+  if (receiveMode) {
+    decodeKeyInput();
+    return;
+  }
+#endif
+
+  if (lineDone && channels[0].keyer.idle()) {
+    showPrompt("Enter a word:");  // Clear the LCD and display the prompt again
+    lineDone = false;
+  }
+#if MORSE_SLOTS
+  runBeacon();
+#endif
+
+  // Stay one character ahead of each keyer: queue the next one while the
+  // gap after the current one is still to come, so the LCD stays in step
+  // with what is being sent
+  for (uint8_t i = 0; i < MORSE_CHANNELS; i++) {
+    Channel& channel = channels[i];
+    if (i == 0 && lineDone) {
+      continue;
+    }
+    bool keyerReady = channel.keyer.queued() <= 1 && channel.keyer.space() >= maxCharElements;
+#if MORSE_SLOTS
+    if (&channel == saveChannel && saveStarted) {
+      saveNextChar(channel);
+      continue;
+    }
+    if (&channel == playChannel) {
+      if (keyerReady) {
+        playSlotLetter(channel);
+      }
+      continue;
+    }
+#endif
+#if MORSE_ABBREV
+    if (keyerReady && channel.abbrev == morseNoAbbrev && startAbbrev(channel) == ABBREV_WAIT) {
+      continue;
+    }
+    if (keyerReady && channel.abbrev != morseNoAbbrev) {
+      MORSE_TRACE_SCOPE(STAGE_SEND);
+      sendAbbrevLetter(channel);
+      continue;
+    }
+#endif
+    if (!channel.queue.empty() && keyerReady) {
+      MORSE_TRACE_SCOPE(STAGE_SEND);
+      char c = channel.queue.pop();
+#if MORSE_SLOTS
+      if (c == saveMarker) {
+        saveStarted = true;
+        continue;
+      }
+#endif
+      sendCharacter(channel, c);
+    }
+  }
+}
+
+// Sort an incoming byte into a command line or the text queue
+void receiveByte(char c) {
+  MORSE_TRACE_EVENT(TRACE_RX, c);
+#if MORSE_ABBREV
+  lastRxMs = millis();
+#endif
+  bool endOfLine = c == '\n' || c == '\r';
+
+  if (c == XON || c == XOFF) {
+    return;  // Flow control from the other end; nothing to send
+  }
+
+#if MORSE_PROTOCOL
+  if (frames.active() || c == frameStx) {
+    switch (frames.feed(c, millis())) {
+      case FrameReader::READ_FRAME:
+        handleFrame();
+        break;
+      case FrameReader::READ_ERROR:
+        sendNak(frames.seq, frames.error);
+        break;
+      default:
+        break;
+    }
+    return;
+  }
+#endif
+
+  if (inCommand) {
+    if (endOfLine) {
+      commandLine[commandLength] = '\0';
+      runCommand(commandLine);
+      inCommand = false;
+      atLineStart = true;
+    } else if (commandLength < sizeof(commandLine) - 1) {
+      commandLine[commandLength++] = c;
+    }
+    return;
+  }
+
+  if (atLineStart && c == '#') {
+    inCommand = true;
+    commandLength = 0;
+    return;
+  }
+
+  queueText(c);
+  atLineStart = endOfLine;
+}
+
+// Queue the next byte of UTF-8 text as the current alphabet's byte(s)
+void queueText(char c) {
+  uint16_t cp;
+  if (!utf8.feed(c, cp)) {
+    return;  // Partway through a multi-byte character
+  }
+  uint8_t bytes[2];
+  // Control characters have no code either, and keep the queue free for
+  // markers such as saveMarker
+  uint8_t n = cp < ' ' && c != '\n' && c != '\r' ? 0 : morseFromUnicode(cp, alphabet, bytes);
+  if (n == 0) {
+    input->queue.push(unknownChar);
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    input->queue.push(bytes[i]);
+  }
+}
+
+#if MORSE_PROTOCOL
+void sendAck(uint8_t seq) {
+  unsigned int space = input->queue.capacity() - input->queue.count();
+  uint8_t payload[2] = { (uint8_t)(space >> 8), (uint8_t)space };
+  frameSend(Serial, FRAME_ACK, seq, payload, sizeof(payload));
+}
+
+void sendNak(uint8_t seq, uint8_t error) {
+  frameSend(Serial, FRAME_NAK, seq, &error, 1);
+}
+
+// Answer FRAME_STATUS with, big-endian, for the selected channel:
+//   0  text queue count (2 bytes)    8  pitch in Hz (2 bytes)
+//   2  text queue size (2 bytes)    10  brightness
+//   4  elements queued for keying   11  alphabet (MorseAlphabet)
+//   5  flags: 1 keying, 2 XOFF      12  characters keyed (4 bytes)
+//      sent, 4 receive mode         16  characters with no code (2 bytes)
+//   6  character WPM                18  selected channel
+//   7  effective WPM                19  number of channels
+//                                   20  sidetone volume
+//                                   21  units saved by abbreviations
+//                                       in the last line (2 bytes)
+// The two counts are for all channels together, as is the last line.
+// Pitch and volume are 0 without MORSE_BUZZER, the saving without
+// MORSE_ABBREV.
+void sendStatus(uint8_t seq) {
+  unsigned int count = input->queue.count();
+  Keyer& keyer = input->keyer;
+  uint8_t flags = (keyer.idle() ? 0 : 1) | (inputPaused ? 2 : 0) | (receiveMode ? 4 : 0);
+#if MORSE_ABBREV
+  unsigned int saved = lastUnitsSaved;
+#else
+  unsigned int saved = 0;
+#endif
+  uint8_t payload[23] = {
+    (uint8_t)(count >> 8), (uint8_t)count,
+    (uint8_t)(inputQueueSize >> 8), (uint8_t)inputQueueSize,
+    keyer.queued(), flags, input->timing.charWpm, input->timing.effectiveWpm,
+#if MORSE_BUZZER
+    (uint8_t)(keyer.pitch >> 8), (uint8_t)keyer.pitch,
+#else
+    0, 0,
+#endif
+    keyer.brightness, alphabet,
+    (uint8_t)(charsSent >> 24), (uint8_t)(charsSent >> 16), (uint8_t)(charsSent >> 8), (uint8_t)charsSent,
+    (uint8_t)(charErrors >> 8), (uint8_t)charErrors,
+    (uint8_t)(input - channels), MORSE_CHANNELS,
+#if MORSE_BUZZER
+    sidetone.volume,
+#else
+    0,
+#endif
+    (uint8_t)(saved >> 8), (uint8_t)saved
+  };
+  frameSend(Serial, FRAME_STATUS_REPLY, seq, payload, sizeof(payload));
+}
+
+// Drop the selected channel's queued text and stop it keying, even partway
+// through a character
+void abortSending() {
+  input->keyer.abort();
+  input->queue.clear();
+  utf8 = Utf8Decoder();
+#if MORSE_ABBREV
+  input->abbrev = morseNoAbbrev;
+  input->wordStart = true;
+#endif
+#if MORSE_SLOTS
+  if (input == playChannel) {
+    slots.stopPlay();
+    playChannel = NULL;
+  }
+  if (input == saveChannel) {
+    slots.cancelSave();  // Its marker went with the queue
+    saveChannel = NULL;
+  }
+#endif
+  if (input == &channels[0] && !receiveMode) {
+    lineDone = false;
+    showPrompt("Enter a word:");
+  }
+}
+
+// Carry out the frame just read and answer it
+void handleFrame() {
+  const uint8_t* p = frames.payload;
+  uint8_t length = frames.length;
+  int textSeq = lastTextSeq;
+  lastTextSeq = -1;
+  switch (frames.type) {
+    case FRAME_TEXT:
+      if (frames.seq == textSeq) {
+        lastTextSeq = textSeq;
+        break;  // Our ACK was lost; the text is already queued
+      }
+      // A byte of UTF-8 never queues more than one byte, bar the second
+      // byte of a voiced kana that a previous frame left half decoded
+      if (input->queue.capacity() - input->queue.count() < length + 1U) {
+        sendNak(frames.seq, FRAME_QUEUE_FULL);
+        return;
+      }
+      for (uint8_t i = 0; i < length; i++) {
+        queueText(p[i]);
       }
-      delay(time_delay); // Maintain a delay for spaces
+      lastTextSeq = frames.seq;
+      break;
+    case FRAME_SET_WPM:
+      if (length != 2 || p[0] < minWpm || p[0] > maxWpm) {
+        sendNak(frames.seq, FRAME_BAD_VALUE);
+        return;
+      }
+      input->timing = morseTiming(p[0], p[1]);
+      break;
+#if MORSE_BUZZER
+    case FRAME_SET_PITCH: {
+      unsigned int hz = length == 2 ? (p[0] << 8) | p[1] : 0;
+      if (hz < minPitch || hz > maxPitch) {
+        sendNak(frames.seq, FRAME_BAD_VALUE);
+        return;
+      }
+      input->keyer.setPitch(hz);
+      break;
+    }
+    case FRAME_SET_VOLUME:
+      if (length != 1) {
+        sendNak(frames.seq, FRAME_BAD_VALUE);
+        return;
+      }
+      sidetone.volume = p[0];
+      break;
+#endif
+    case FRAME_SET_BRIGHTNESS:
+      if (length != 1) {
+        sendNak(frames.seq, FRAME_BAD_VALUE);
+        return;
+      }
+      brightness = p[0];
+      input->keyer.brightness = p[0];
+#if MORSE_ERROR_LED
+      errorFlasher.brightness = p[0];
+#endif
+      break;
+    case FRAME_SET_CHANNEL:
+      if (length != 1 || p[0] >= MORSE_CHANNELS) {
+        sendNak(frames.seq, FRAME_BAD_VALUE);
+        return;
+      }
+      input = &channels[p[0]];
+      break;
+    case FRAME_STATUS:
+      sendStatus(frames.seq);
+      return;
+    case FRAME_ABORT:
+      abortSending();
+      break;
+    default:
+      sendNak(frames.seq, FRAME_UNKNOWN_TYPE);
       return;
+  }
+  sendAck(frames.seq);
+}
+#endif
+
+// Pause and resume the sender around the queue's watermarks
+void updateFlowControl() {
+  if (!inputPaused && input->queue.count() >= inputHighWater) {
+    Serial.write(XOFF);
+    inputPaused = true;
+  } else if (inputPaused && input->queue.count() <= inputLowWater) {
+    Serial.write(XON);
+    inputPaused = false;
+  }
+}
+
+// Milliseconds it will take to key c at timing, including the gap after it
+unsigned long characterTime(const MorseTiming& timing, char c) {
+  if (c == '\n' || c == '\r') {
+    return newlineHold;
+  }
+  if (c == ' ') {
+    return timing.wordGap - timing.letterGap;
+  }
+  uint8_t code = morseEncode(c, alphabet);
+  if (code == morseInvalid && invalidPolicy == INVALID_SUBSTITUTE) {
+    code = morseEncode(invalidSubstitute, alphabet);
+  }
+  if (code == morseInvalid) {
+    return 0;  // Skipped
+  }
+  unsigned long total = timing.letterGap - timing.elementGap;
+  for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+    total += ((code & element) ? timing.dash : timing.dot) + timing.elementGap;
+  }
+  return total;
+}
+
+// Report how much text is waiting on the selected channel and roughly how
+// long it will take
+void printStatus() {
+  unsigned long drainMs = 0;
+  for (unsigned int i = 0; i < input->queue.count(); i++) {
+    drainMs += characterTime(input->timing, input->queue.peek(i));
+  }
+  if (MORSE_CHANNELS > 1) {
+    Serial.print("Channel ");
+    Serial.print((int)(input - channels));
+    Serial.print(": ");
+  }
+  Serial.print("Queue ");
+  Serial.print(input->queue.count());
+  Serial.print("/");
+  Serial.print(inputQueueSize);
+  Serial.print(" chars, ");
+  Serial.print(drainMs / 1000.0, 1);
+  Serial.println(" s to drain");
+  Serial.print("Sent ");
+  Serial.print(charsSent);
+  Serial.print(" chars, ");
+  Serial.print(charErrors);
+  Serial.println(" with no code");
+#if MORSE_ABBREV
+  Serial.print("Abbreviations saved ");
+  Serial.print(lastUnitsSaved);
+  Serial.print(" units on the last line, ");
+  Serial.print(totalUnitsSaved);
+  Serial.println(" in all");
+#endif
+}
+
+void printSpeed() {
+  const MorseTiming& timing = input->timing;
+  Serial.print("Speed ");
+  Serial.print(timing.charWpm);
+  Serial.print(" WPM");
+  if (timing.effectiveWpm != timing.charWpm) {
+    Serial.print(", Farnsworth ");
+    Serial.print(timing.effectiveWpm);
+    Serial.print(" WPM");
+  }
+  Serial.println();
+}
+
+// Parse text as a whole number from low to high into value. Returns false,
+// leaving value alone, for anything else.
+bool parseNumber(const char* text, long low, long high, long& value) {
+  char* end;
+  long n = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || n < low || n > high) {
+    return false;
+  }
+  value = n;
+  return true;
+}
+
+// Set the character speed, keeping any Farnsworth speed below it
+void setSpeed(const char* wpm) {
+  MorseTiming& timing = input->timing;
+  long n;
+  if (parseNumber(wpm, minWpm, maxWpm, n)) {
+    timing = morseTiming(n, timing.effectiveWpm == timing.charWpm ? 0 : timing.effectiveWpm);
+  } else {
+    Serial.print("Use #wpm ");
+    Serial.print(minWpm);
+    Serial.print(" to ");
+    Serial.println(maxWpm);
+  }
+  printSpeed();
+}
+
+// Set the Farnsworth speed; 0 turns it off
+void setFarnsworth(const char* wpm) {
+  MorseTiming& timing = input->timing;
+  long n;
+  if (parseNumber(wpm, 0, timing.charWpm, n) && (n == 0 || n >= minWpm)) {
+    timing = morseTiming(timing.charWpm, n);
+  } else {
+    Serial.print("Use #fwpm 0 (off) or ");
+    Serial.print(minWpm);
+    Serial.print(" to ");
+    Serial.println(timing.charWpm);
+  }
+  printSpeed();
+}
+
+// Commands take effect from the next character handed to the keyer
+void runCommand(const char* command) {
+  if (strcmp(command, "status") == 0) {
+    printStatus();
+  } else if (strncmp(command, "wpm ", 4) == 0) {
+    setSpeed(command + 4);
+  } else if (strncmp(command, "fwpm ", 5) == 0) {
+    setFarnsworth(command + 5);
+#if MORSE_BUZZER
+  } else if (strncmp(command, "pitch ", 6) == 0) {
+    unsigned int hz = atoi(command + 6);
+    if (hz >= minPitch && hz <= maxPitch) {
+      input->keyer.setPitch(hz);
+    }
+    Serial.print("Pitch ");
+    Serial.print(input->keyer.pitch);
+    Serial.println(" Hz");
+  } else if (strncmp(command, "vol ", 4) == 0) {
+    int level = atoi(command + 4);
+    sidetone.volume = level < 0 ? 0 : level > 255 ? 255 : level;
+    Serial.print("Volume ");
+    Serial.println(sidetone.volume);
+#endif
+  } else if (strncmp(command, "ch", 2) == 0) {
+    selectChannel(command[2] == ' ' ? command + 3 : "");
+#if MORSE_RECEIVE
+  } else if (strncmp(command, "rx", 2) == 0) {
+    // Optional first guess at the sender's speed; it adapts from there
+    int wpm = atoi(command + 2);
+    setReceiveMode(true, wpm >= minWpm && wpm <= maxWpm ? wpm : input->timing.charWpm);
+  } else if (strcmp(command, "tx") == 0) {
+    setReceiveMode(false, 0);
+#endif
+#if MORSE_SLOTS
+  } else if (runSlotCommand(command)) {
+#endif
+  } else if (strncmp(command, "alpha", 5) == 0) {
+    setAlphabet(command[5] == ' ' ? command + 6 : "");
+#if MORSE_ABBREV
+  } else if (strncmp(command, "abbrev", 6) == 0) {
+    setAbbreviate(command[6] == ' ' ? command + 7 : "");
+#endif
+  } else if (strncmp(command, "bad", 3) == 0) {
+    setInvalidPolicy(command[3] == ' ' ? command + 4 : "");
+  } else if (strncmp(command, "trace", 5) == 0) {
+#if MORSE_TRACE
+    if (strcmp(command + 5, " clear") == 0) {
+      tracer.clear();
+    } else {
+      tracer.dump(Serial);
+    }
+#else
+    Serial.println("Tracing is not built in, see MORSE_TRACE");
+#endif
+  } else {
+    Serial.print("Unknown command: #");
+    Serial.println(command);
+  }
+}
+
+// Send typed text to channel number n, or report the selected channel
+void selectChannel(const char* n) {
+  if (*n != '\0') {
+    int channel = atoi(n);
+    if (channel >= 0 && channel < MORSE_CHANNELS) {
+      input = &channels[channel];
+    } else {
+      Serial.print("No such channel: ");
+      Serial.println(n);
     }
+  }
+  Serial.print("Channel ");
+  Serial.print((int)(input - channels));
+  Serial.print(" of ");
+  Serial.println(MORSE_CHANNELS);
+}
 
-    // Append character to the inputText
-    inputText += c;
+// Switch to the alphabet called name, or report the current one
+void setAlphabet(const char* name) {
+  for (uint8_t i = 0; i < morseAlphabets; i++) {
+    if (strcmp(name, alphabetNames[i]) == 0) {
+      alphabet = i;
+#if MORSE_RECEIVE
+      decoder.alphabet = i;
+#endif
+    }
+  }
+  if (*name != '\0' && strcmp(name, alphabetNames[alphabet]) != 0) {
+    Serial.print("Unknown alphabet: ");
+    Serial.println(name);
+  }
+  Serial.print("Alphabet ");
+  Serial.println(alphabetNames[alphabet]);
+}
 
-    // Display the character on the LCD
-    lcd.setCursor(0, 1);
-    if (inputText.length() <= 16) {
-      lcd.print(inputText);
+// Set what happens to characters with no code from "skip" or "sub C", or
+// report it
+void setInvalidPolicy(const char* policy) {
+  if (strcmp(policy, "skip") == 0) {
+    invalidPolicy = INVALID_SKIP;
+  } else if (strncmp(policy, "sub ", 4) == 0 && policy[4] != '\0' && policy[5] == '\0') {
+    invalidPolicy = INVALID_SUBSTITUTE;
+    invalidSubstitute = policy[4];
+  } else if (*policy != '\0') {
+    Serial.println("Use #bad skip or #bad sub C");
+  }
+  if (invalidPolicy == INVALID_SKIP) {
+    Serial.println("Characters with no code are skipped");
+  } else {
+    Serial.print("Characters with no code are sent as ");
+    Serial.println(invalidSubstitute);
+  }
+}
+
+#if MORSE_ABBREV
+// Turn abbreviation on or off from "on" or "off", or report it
+void setAbbreviate(const char* on) {
+  if (strcmp(on, "on") == 0 || strcmp(on, "off") == 0) {
+    abbreviate = on[1] == 'n';
+  } else if (*on != '\0') {
+    Serial.println("Use #abbrev on or #abbrev off");
+  }
+  Serial.print("Abbreviations ");
+  Serial.println(abbreviate ? "on" : "off");
+}
+#endif
+
+#if MORSE_RECEIVE
+// Add a received character to the second LCD row and echo it to Serial
+void showDecoded(char c) {
+  showInputChar(c);
+  if (!morseEcho) {
+    return;
+  }
+  char utf[3];
+  uint8_t n = utf8Encode(morseToUnicode(c, alphabet), utf);
+  for (uint8_t i = 0; i < n; i++) {
+    Serial.write(utf[i]);
+  }
+}
+
+// Decode the key edges queued by the interrupt since the last pass. Each
+// gap is judged at the time of the edge that ends it, so a slow pass of
+// loop() cannot turn a letter gap into a word gap.
+void decodeKeyInput() {
+  uint32_t edge;
+  char c;
+  while (keyEdges.pop(edge)) {
+    unsigned long us = edge & ~1UL;
+    while ((c = decoder.poll(us)) != 0) {
+      showDecoded(c);
+    }
+    decoder.edge(edge & 1, us);
+  }
+  while ((c = decoder.poll(micros())) != 0) {
+    showDecoded(c);
+  }
+}
+
+// Switch between sending typed text and decoding the key input
+void setReceiveMode(bool on, uint8_t wpm) {
+  receiveMode = on;
+  if (on) {
+    keyEdges.clear();
+    decoder.reset(wpm);
+    showPrompt("Receiving:");
+    if (morseEcho) {
+      Serial.println("Receiving, #tx to stop");
+    }
+  } else {
+    if (morseEcho) {
+      Serial.println();
+    }
+    showPrompt("Enter a word:");
+  }
+}
+#endif
+
+#if MORSE_SLOTS
+// Save the next character of the line after saveMarker, once the EEPROM
+// has caught up with the last one
+void saveNextChar(Channel& channel) {
+  if (channel.queue.empty() || slots.writing()) {
+    return;
+  }
+  char c = channel.queue.pop();
+  if (c == '\n' || c == '\r') {
+    char name[MessageSlots::nameLength + 1];
+    strncpy(name, slots.savingName(), MessageSlots::nameLength);
+    name[MessageSlots::nameLength] = '\0';
+    uint16_t count = slots.endSave();
+    saveChannel = NULL;
+    Serial.print("Saved ");
+    Serial.print(name);
+    Serial.print(", ");
+    Serial.print(count);
+    Serial.print(slots.truncated() ? " symbols, cut short" : " symbols");
+    if (saveSkipped > 0) {
+      Serial.print(", ");
+      Serial.print(saveSkipped);
+      Serial.print(" with no code left out");
+    }
+    Serial.println();
+  } else if (c == ' ') {
+    slots.addWordGap();
+  } else {
+    uint8_t code = morseEncode(c, alphabet);
+    if (code == morseInvalid) {
+      saveSkipped++;
     } else {
-      lcd.print(inputText.substring(inputText.length() - 16));
-    }
-
-    // Check for newline or carriage return
-    if (c != '\n' && c != '\r') {
-        bool validCharacter = false;  // Flag to check if the character is valid
-
-        if (c >= 'a' && c <= 'z') {
-          blinkMorse(morseCode[c - 'a']);
-          validCharacter = true;
-        } else if (c >= 'A' && c <= 'Z') {
-          blinkMorse(morseCode[c - 'A']);
-          validCharacter = true;
-        } else if (c >= '0' && c <= '9') {
-          blinkMorse(morseCode[c - '0' + 26]);
-          validCharacter = true;
-        } else {
-          switch(c) {
-            case ',': blinkMorse(morseCode[36]); validCharacter = true; break;
-            case '.': blinkMorse(morseCode[37]); validCharacter = true; break;
-            case ';': blinkMorse(morseCode[38]); validCharacter = true; break;
-            case ':': blinkMorse(morseCode[39]); validCharacter = true; break;
-            case '\'': blinkMorse(morseCode[40]); validCharacter = true; break;
-            case '\"': blinkMorse(morseCode[41]); validCharacter = true; break;
-            case '-': blinkMorse(morseCode[42]); validCharacter = true; break;
-          }
-        }
+      slots.addCode(code);
+    }
+  }
+}
 
-        // If the character was not valid, handle the error
-        if (!validCharacter) {
-            handleError();
-        } else {
-            delay(time_delay);  // Gap between letters
+// Queue the elements of the next letter or word gap of the slot being
+// played, straight from its symbols
+void playSlotLetter(Channel& channel) {
+  Keyer& keyer = channel.keyer;
+  const MorseTiming& timing = channel.timing;
+  for (;;) {
+    switch (slots.nextSymbol()) {
+      case SLOT_DOT:
+        keyer.send(Keyer::on(timing.dot));
+        keyer.send(Keyer::off(timing.elementGap));
+        break;
+      case SLOT_DASH:
+        keyer.send(Keyer::on(timing.dash));
+        keyer.send(Keyer::off(timing.elementGap));
+        break;
+      case SLOT_LETTER_END:
+        keyer.send(Keyer::off(timing.letterGap - timing.elementGap));
+        charsSent++;
+        return;
+      case SLOT_WORD_END:
+        keyer.send(Keyer::off(timing.wordGap - timing.letterGap));
+        return;
+      default:
+        playChannel = NULL;
+        if (&channel == &channels[0]) {
+          lineDone = true;  // Back to the prompt once keyed
         }
-    } else { // If it's a newline or carriage return
-        delay(2000);  // A 2-second delay to let the user read the scrolled message
-        lcd.clear();  // Clear the LCD
-        inputText = "";  // Clear the inputText
-        lcd.print("Enter a word:");  // Display the prompt again
+        return;
+    }
+  }
+}
+
+void startPlay(Channel& channel, uint8_t slot) {
+  slots.beginPlay(slot);
+  playChannel = &channel;
+  if (&channel == &channels[0]) {
+    char name[MessageSlots::nameLength + 1];
+    slots.getName(slot, name);
+    showPrompt("Playing:");
+    display.setCursor(0, 1);
+    display.print(name);
+  }
+}
+
+// Start the beacon message whenever channel 0 has been idle for the pause
+void runBeacon() {
+  Channel& channel = channels[0];
+  if (beaconSlot == MessageSlots::noSlot || playChannel != NULL) {
+    return;
+  }
+  if (!channel.keyer.idle() || !channel.queue.empty() || saveChannel == &channel) {
+    beaconIdleSince = millis();
+    return;
+  }
+  if (millis() - beaconIdleSince >= beaconPauseS * 1000UL) {
+    startPlay(channel, beaconSlot);
+  }
+}
+
+// Slot named name, or noSlot after saying there is none
+int namedSlot(const char* name) {
+  int slot = slots.find(name);
+  if (slot == MessageSlots::noSlot) {
+    Serial.print("No slot called ");
+    Serial.println(name);
+  }
+  return slot;
+}
+
+void listSlots() {
+  char name[MessageSlots::nameLength + 1];
+  for (uint8_t slot = 0; slot < MessageSlots::slotCount; slot++) {
+    Serial.print(slot);
+    Serial.print(": ");
+    if (!slots.getName(slot, name)) {
+      Serial.println("empty");
+      continue;
+    }
+    Serial.print(name);
+    Serial.print(", ");
+    Serial.print(slots.symbols(slot));
+    Serial.print(" symbols");
+    if (slot == beaconSlot) {
+      Serial.print(", beacon every ");
+      Serial.print(beaconPauseS);
+      Serial.print(" s");
+    }
+    Serial.println();
+  }
+}
+
+// Set the beacon from "NAME SECONDS" or "off"
+void setBeacon(const char* args) {
+  if (strcmp(args, "off") == 0) {
+    beaconSlot = MessageSlots::noSlot;
+    slots.setBeacon(beaconSlot, 0);
+    Serial.println("Beacon off");
+    return;
+  }
+  char name[MessageSlots::nameLength + 1];
+  const char* space = strchr(args, ' ');
+  size_t length = space != NULL ? space - args : 0;
+  long pause = space != NULL ? atol(space + 1) : -1;
+  if (length == 0 || length > MessageSlots::nameLength || pause < 0 || pause > 65535) {
+    Serial.println("Use #beacon NAME SECONDS or #beacon off");
+    return;
+  }
+  memcpy(name, args, length);
+  name[length] = '\0';
+  int slot = namedSlot(name);
+  if (slot == MessageSlots::noSlot) {
+    return;
+  }
+  beaconSlot = slot;
+  beaconPauseS = pause;
+  slots.setBeacon(slot, pause);
+  Serial.print("Beacon ");
+  Serial.print(name);
+  Serial.print(" every ");
+  Serial.print(pause);
+  Serial.println(" s");
+}
+
+// Save the line after the command into the slot called name, replacing
+// any slot of that name
+void saveSlot(const char* name) {
+  size_t length = strlen(name);
+  if (length == 0 || length > MessageSlots::nameLength) {
+    Serial.println("Use #save NAME, with up to 8 characters, then the text on the next line");
+    return;
+  }
+  if (saveChannel != NULL) {
+    Serial.println("Already saving");
+    return;
+  }
+  int slot = slots.find(name);
+  if (slot == MessageSlots::noSlot) {
+    slot = slots.freeSlot();
+  }
+  if (slot == MessageSlots::noSlot) {
+    Serial.println("No free slot, #erase one first");
+    return;
+  }
+  if (slot == slots.playingSlot()) {
+    slots.stopPlay();
+    playChannel = NULL;
+  }
+  if (!input->queue.push(saveMarker)) {
+    Serial.println("Queue full, try again");
+    return;
+  }
+  slots.beginSave(slot, name);
+  saveChannel = input;
+  saveStarted = false;
+  saveSkipped = 0;
+  Serial.print("Saving the next line as ");
+  Serial.println(name);
+}
+
+// Run command if it is one of the slot commands. Returns false if not.
+bool runSlotCommand(const char* command) {
+  if (strncmp(command, "save ", 5) == 0) {
+    saveSlot(command + 5);
+  } else if (strncmp(command, "play ", 5) == 0) {
+    int slot = namedSlot(command + 5);
+    if (slot != MessageSlots::noSlot && playChannel != NULL) {
+      Serial.println("Already playing");
+    } else if (slot != MessageSlots::noSlot) {
+      startPlay(*input, slot);
     }
+  } else if (strncmp(command, "erase ", 6) == 0) {
+    int slot = namedSlot(command + 6);
+    if (slot != MessageSlots::noSlot && (slot == slots.playingSlot() || saveChannel != NULL)) {
+      Serial.println("Slot in use");
+    } else if (slot != MessageSlots::noSlot) {
+      slots.erase(slot);
+      if (slot == beaconSlot) {
+        beaconSlot = MessageSlots::noSlot;
+      }
+    }
+  } else if (strncmp(command, "beacon ", 7) == 0) {
+    setBeacon(command + 7);
+  } else if (strcmp(command, "slots") == 0) {
+    listSlots();
+  } else {
+    return false;
+  }
+  return true;
+}
+#endif
+
+#if MORSE_LCD
+// The LCD's character ROM has ASCII and the JIS X 0201 katakana. Other
+// alphabets' letters are shown as the Latin letter with the same code.
+char lcdChar(char c) {
+  if ((uint8_t)c < 0x80 || alphabet == MORSE_WABUN) {
+    return c;
   }
+  char latin = morseDecode(morseEncode(c, alphabet));
+  return latin != 0 ? latin : c;
 }
 
+// Show the last 16 characters of the input on the second LCD row
+void showInputText() {
+  display.setCursor(0, 1);
+  for (unsigned int i = 0; i < inputText.count(); i++) {
+    display.write(lcdChar(inputText.peek(i)));
+  }
+  display.clearToEnd();
+}
+#endif
+
+// Add c to the end of the second LCD row
+void showInputChar(char c) {
+#if MORSE_LCD
+  inputText.pushOverwrite(c);
+  showInputText();
+#else
+  (void)c;
+#endif
+}
 
-void blinkMorse(char* code) {
-  for (int i = 0; i < strlen(code); i++) {
-    if (code[i] == '.') {
-      analogWrite(morseLedPin, brightness);  // Control brightness
-      tone(buzzerPin, 1000, 300);  // Start sound at 1000Hz for 300ms
-      delay(300);
-      analogWrite(morseLedPin, 0);  // Turn off
-      noTone(buzzerPin);  // Stop sound
-      delay(200);
-    } else if (code[i] == '-') {
-      analogWrite(morseLedPin, brightness);  // Control brightness
-      tone(buzzerPin, 1000, 1000);  // Start sound at 1000Hz for 1000ms
-      delay(1000);
-      analogWrite(morseLedPin, 0);  // Turn off
-      noTone(buzzerPin);  // Stop sound
-      delay(200);
+// Blank the LCD and show prompt on its first row
+void showPrompt(const char* prompt) {
+#if MORSE_LCD
+  inputText.clear();
+#endif
+  display.clear();
+  display.print(prompt);
+}
+
+// Count a character with no code and say which column of its line it was
+// in, on Serial and in place of the prompt, while the error LED flashes in
+// the background. Nothing waits, so input and keying carry straight on.
+void reportInvalid(Channel& channel) {
+  MORSE_TRACE_SCOPE(STAGE_ERROR);
+  charErrors++;
+#if MORSE_ERROR_LED
+  errorFlasher.flash(errorFlashes);
+#endif
+  char column[6];
+  uint8_t n = sizeof(column) - 1;
+  column[n] = '\0';
+  for (uint16_t col = channel.column; n == sizeof(column) - 1 || col != 0; col /= 10) {
+    column[--n] = '0' + col % 10;
+  }
+  if (&channel == &channels[0]) {
+    display.setCursor(0, 0);  // The prompt comes back with the next line
+    display.print("No code, col ");
+    display.print(column + n);
+    display.clearToEnd();
+  }
+  if (morseEcho) {
+    if (MORSE_CHANNELS > 1) {
+      Serial.print("Channel ");
+      Serial.print((int)(&channel - channels));
+      Serial.print(": ");
+    }
+    Serial.print("No code for the character at column ");
+    Serial.print(column + n);
+    if (invalidPolicy == INVALID_SKIP) {
+      Serial.println(", skipped");
+    } else {
+      Serial.print(", sent as ");
+      Serial.println(invalidSubstitute);
     }
   }
 }
 
+// Queue c's elements for channel's keyer, showing it on the LCD if the
+// channel is channel 0
+void sendCharacter(Channel& channel, char c) {
+  Keyer& keyer = channel.keyer;
+  const MorseTiming& timing = channel.timing;
+  bool shown = &channel == &channels[0];
+
+#if MORSE_ABBREV
+  channel.wordStart = morseAbbrevBoundary(c);
+#endif
+
+  if (c == '\n' || c == '\r') {
+    keyer.send(Keyer::off(newlineHold));  // Let the user read the scrolled message
+    if (shown) {
+      lineDone = true;
+    }
+    channel.column = 0;
+#if MORSE_ABBREV
+    if (channel.unitsSaved > 0) {
+      lastUnitsSaved = channel.unitsSaved;
+      totalUnitsSaved += channel.unitsSaved;
+      channel.unitsSaved = 0;
+      if (morseEcho) {
+        Serial.print("Abbreviations saved ");
+        Serial.print(lastUnitsSaved);
+        Serial.println(" units");
+      }
+    }
+#endif
+    return;
+  }
+  channel.column++;
+
+  if (c == ' ') {
+    if (shown) {
+      showInputChar(c);
+    }
+    // The letter gap has already been sent; stretch it to a word gap
+    keyer.send(Keyer::off(timing.wordGap - timing.letterGap));
+    return;
+  }
+
+  uint8_t code = morseEncode(c, alphabet);
+  if (code == morseInvalid) {
+    MORSE_TRACE_EVENT(TRACE_ERROR, c);
+    reportInvalid(channel);
+    if (invalidPolicy == INVALID_SKIP) {
+      return;
+    }
+    c = invalidSubstitute;
+    code = morseEncode(c, alphabet);
+    if (code == morseInvalid) {
+      return;  // The substitute has no code in this alphabet either
+    }
+  }
+  if (shown) {
+    showInputChar(c);
+  }
+  MORSE_TRACE_EVENT(TRACE_LOOKUP, c);
+  keyCode(channel, code);
+}
+
+// Queue the elements of a packed code and the letter gap after it
+void keyCode(Channel& channel, uint8_t code) {
+  Keyer& keyer = channel.keyer;
+  const MorseTiming& timing = channel.timing;
+  MORSE_TRACE_START(STAGE_KEY);
+  charsSent++;
+  for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+    keyer.send(Keyer::on((code & element) ? timing.dash : timing.dot));
+    keyer.send(Keyer::off(timing.elementGap));
+  }
+  keyer.send(Keyer::off(timing.letterGap - timing.elementGap));  // Gap between letters
+}
+
+#if MORSE_ABBREV
+// If the channel's queue starts with a phrase at the start of a word,
+// drop it and set its replacement keying in its place
+AbbrevStart startAbbrev(Channel& channel) {
+  if (!abbreviate || !channel.wordStart || channel.queue.empty()) {
+    return ABBREV_NONE;
+  }
+  uint8_t length;
+  bool more;
+  int abbrev = morseAbbrevMatch(channel.queue, length, more);
+  if (more && millis() - lastRxMs < abbrevWaitMs) {
+    return ABBREV_WAIT;  // The rest of the phrase may be on its way
+  }
+  if (abbrev == morseNoAbbrev) {
+    return ABBREV_NONE;
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    channel.queue.pop();
+  }
+  channel.abbrev = abbrev;
+  channel.abbrevAt = 0;
+  channel.unitsSaved += morseAbbrevSaving(abbrev);
+  channel.column += length;
+  channel.wordStart = false;
+  return ABBREV_STARTED;
+}
+
+// Key the next letter or prosign of the replacement being keyed, showing
+// it on the LCD as written in the table
+void sendAbbrevLetter(Channel& channel) {
+  uint8_t from = channel.abbrevAt;
+  uint8_t code = morseAbbrevCode(channel.abbrev, channel.abbrevAt);
+  if (&channel == &channels[0]) {
+    for (uint8_t i = from; i < channel.abbrevAt; i++) {
+      showInputChar(pgm_read_byte(&morseAbbrevs[channel.abbrev].replacement[i]));
+    }
+  }
+  if (code != morseInvalid) {
+    keyCode(channel, code);
+  }
+  if (pgm_read_byte(&morseAbbrevs[channel.abbrev].replacement[channel.abbrevAt]) == '\0') {
+    channel.abbrev = morseNoAbbrev;
+  }
+}
+#endif
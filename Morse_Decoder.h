@@ -0,0 +1,105 @@
+/*
+   Morse receiver: turns key edges back into text.
+
+   Marks are sorted into dots and dashes against a running estimate of the
+   sender's dot length, which is nudged towards every mark received, so the
+   decoder follows a sender who speeds up or slows down. Gaps are judged
+   against the same estimate: under two dots is the gap inside a character,
+   two to five ends the character, and more than five ends the word. The
+   elements so far are kept as a morseTree[] index, so the whole state is a
+   handful of bytes however long the message is. Characters come back as
+   bytes of the alphabet's code page (see Morse_Table.h).
+*/
+
+#ifndef MORSE_DECODER_H
+#define MORSE_DECODER_H
+
+#include "Morse_HAL.h"
+#include "Morse_Table.h"
+
+class MorseDecoder {
+public:
+  static const char unknown = '*';  // Shown for element patterns with no character
+  static const unsigned long bounceUs = 5000;  // Shorter marks are contact bounce
+
+  MorseDecoder() : alphabet(MORSE_LATIN) {
+    reset(12);
+  }
+
+  // Forget any partial character and start from a guess of wpm
+  void reset(uint8_t wpm) {
+    dotUs = 1200000UL / wpm;
+    lastEdgeUs = 0;
+    code = 1;
+    down = false;
+    wordPending = false;
+  }
+
+  // Feed the key going down or up at time us (from micros())
+  void edge(bool keyDown, unsigned long us) {
+    if (keyDown == down) {
+      return;  // Repeated level, e.g. a bounce we already ignored
+    }
+    unsigned long length = us - lastEdgeUs;
+
+    if (!keyDown) {
+      if (length < bounceUs) {
+        return;  // Contact bounce; the key is still down
+      }
+      bool dash = length > 2 * dotUs;
+      if (length < dotUs / 2) {
+        dotUs = length;  // Far shorter than a dot: the sender sped up
+      } else if (length > 6 * dotUs) {
+        dotUs = length / 3;  // Far longer than a dash: the sender slowed down
+      } else {
+        // Move the dot estimate a quarter of the way towards this mark
+        long target = dash ? length / 3 : length;
+        dotUs += (target - (long)dotUs) / 4;
+      }
+      code = code < 0x80 ? (code << 1) | (dash ? 1 : 0) : 0xFF;
+    }
+
+    down = keyDown;
+    lastEdgeUs = us;
+  }
+
+  // Returns the next decoded character, ' ' at the end of a word, or 0 if
+  // nothing is complete yet. Call until it returns 0; pass the time of the
+  // next edge before feeding it so late calls still see the right gap.
+  char poll(unsigned long nowUs) {
+    if (down) {
+      return 0;
+    }
+    unsigned long gap = nowUs - lastEdgeUs;
+    if (code != 1 && gap >= 2 * dotUs) {
+      char c = code == 0xFF ? 0 : morseDecode(code, alphabet);
+      if (c == 0) {
+        c = unknown;
+      }
+      code = 1;
+      wordPending = true;
+      return c;
+    }
+    if (code == 1 && wordPending && gap >= 5 * dotUs) {
+      wordPending = false;
+      return ' ';
+    }
+    return 0;
+  }
+
+  // The sender's speed as currently estimated
+  uint8_t wpm() const {
+    return 1200000UL / dotUs;
+  }
+
+  uint8_t alphabet;  // Page the decoded characters are taken from
+
+private:
+  unsigned long dotUs;
+  unsigned long lastEdgeUs;
+  uint8_t code;  // morseTree[] index of the elements so far, 0xFF if too long
+  bool down;
+  bool wordPending;  // A character ended; a long enough gap makes it a word
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+   Background flashing of the error LED.
+
+   loop() calls flash() and carries straight on; tick(), called from the
+   1 ms timer interrupt next to the keyers, turns the LED on and off. A
+   flash() while one is still running starts it over, so a burst of bad
+   characters gives one unbroken run of flashes rather than a backlog.
+*/
+
+#ifndef MORSE_ERROR_LED_H
+#define MORSE_ERROR_LED_H
+
+#include "Morse_HAL.h"
+#include "Morse_Timer.h"
+
+class ErrorFlasher {
+public:
+  static const uint8_t onMs = 100;
+  static const uint8_t offMs = 25;
+
+  explicit ErrorFlasher(uint8_t pin) : pin(pin), brightness(100), phases(0), remaining(0) {}
+
+  // Flash count times
+  void flash(uint8_t count) {
+    noInterrupts();
+    phases = 2 * count;
+    remaining = 0;
+    interrupts();
+  }
+
+  bool busy() const {
+    return phases != 0 || remaining != 0;
+  }
+
+  // Called from the timer interrupt every keyTickUs
+  void tick() {
+    if (remaining != 0 && --remaining != 0) {
+      return;
+    }
+    if (phases == 0) {
+      return;
+    }
+    phases--;
+    bool on = phases % 2 == 1;  // Odd phases are the flashes, even the gaps after them
+    timerPwmWrite(pin, on ? brightness : 0);
+    remaining = on ? onMs : offMs;
+  }
+
+  const uint8_t pin;
+  volatile uint8_t brightness;
+
+private:
+  volatile uint8_t phases;  // On and off phases still to start
+  volatile uint8_t remaining;  // Ticks left in the current phase
+};
+
+#endif
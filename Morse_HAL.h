@@ -0,0 +1,20 @@
+/*
+   Hardware abstraction for the Morse convertor sketches.
+
+   On the board this just pulls in the Arduino core and the LCD library.
+   On a PC it pulls in the host implementation in host/, which provides the
+   same functions and classes (millis, tone, Serial, LiquidCrystal, ...)
+   on top of a virtual clock that records everything the sketch does.
+*/
+
+#ifndef MORSE_HAL_H
+#define MORSE_HAL_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <LiquidCrystal.h>
+#else
+#include "host/Morse_HAL_Host.h"
+#endif
+
+#endif
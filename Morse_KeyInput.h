@@ -0,0 +1,42 @@
+/*
+   Pin-change interrupt for a straight key or keyer output.
+
+   The key closes the input to ground against the internal pull-up, so LOW
+   means key down. Every change calls keyInputChange(), which the sketch
+   defines, from interrupt context. Only pins 0-7 (port D, pin change
+   group 2) are supported, which covers the free pins on this board.
+
+   On the host, keyInputBegin() registers keyInputChange() with the
+   simulator, which calls it for edges scheduled with sim::pinInput().
+*/
+
+#ifndef MORSE_KEY_INPUT_H
+#define MORSE_KEY_INPUT_H
+
+#include "Morse_HAL.h"
+
+// Defined by the sketch; runs in interrupt context on every edge
+void keyInputChange();
+
+#ifdef ARDUINO
+
+ISR(PCINT2_vect) {
+  keyInputChange();
+}
+
+inline void keyInputBegin(uint8_t pin) {
+  pinMode(pin, INPUT_PULLUP);
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCICR |= _BV(digitalPinToPCICRbit(pin));
+}
+
+#else
+
+inline void keyInputBegin(uint8_t pin) {
+  pinMode(pin, INPUT_PULLUP);
+  sim::attachPinChange(pin, keyInputChange);
+}
+
+#endif
+
+#endif
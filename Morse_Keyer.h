@@ -0,0 +1,142 @@
+/*
+   Interrupt-driven keying engine.
+
+   loop() turns characters into elements and send()s them; tick(), called
+   from the 1 ms timer interrupt, plays them back on the LED and sidetone.
+   An element is a 16-bit word: the top bit says whether the key is down,
+   the low 15 bits how many milliseconds the state lasts. Because the
+   interrupt owns both outputs, LCD writes and Serial prints in loop()
+   cannot stretch or shorten an element.
+
+   With MORSE_BUZZER off the keyer drives the LED alone, and the pitch is
+   not stored.
+*/
+
+#ifndef MORSE_KEYER_H
+#define MORSE_KEYER_H
+
+#include "Morse_HAL.h"
+#include "Morse_Config.h"
+#include "Morse_SpscQueue.h"
+#include "Morse_Timer.h"
+#include "Morse_Trace.h"
+#if MORSE_BUZZER
+#include "Morse_Sidetone.h"
+#endif
+
+class Keyer {
+public:
+  typedef uint16_t Element;
+
+  static const Element keyDown = 0x8000;
+  static const Element durationMask = 0x7FFF;
+
+  static Element on(uint16_t ms) { return keyDown | ms; }
+  static Element off(uint16_t ms) { return ms; }
+
+#if MORSE_BUZZER
+  explicit Keyer(uint8_t ledPin)
+    : ledPin(ledPin), brightness(100), pitch(1000), remaining(0), down(false), busy(false) {}
+#else
+  explicit Keyer(uint8_t ledPin)
+    : ledPin(ledPin), brightness(100), remaining(0), down(false), busy(false) {}
+#endif
+
+  // Queue one element. Returns false if the queue is full.
+  bool send(Element e) {
+    return queue.push(e);
+  }
+
+  // Number of elements that can still be queued
+  uint8_t space() const {
+    return queue.space();
+  }
+
+  // Number of elements waiting to be keyed
+  uint8_t queued() const {
+    return queue.count();
+  }
+
+  // True once every queued element has been keyed
+  bool idle() const {
+    return !busy && queue.empty();
+  }
+
+  // Drop every queued element and key up at once. Called from loop(); the
+  // interrupt is held off meanwhile, so it briefly owns the consumer side.
+  void abort() {
+    noInterrupts();
+    queue.clear();
+    remaining = 0;
+    if (down) {
+      keyUp();
+    }
+    busy = false;
+    interrupts();
+  }
+
+#if MORSE_BUZZER
+  // Change the pitch, in the middle of a mark if need be
+  void setPitch(unsigned int hz) {
+    pitch = hz;
+    sidetone.setPitch(this, hz);
+  }
+#endif
+
+  // Called from the timer interrupt every keyTickUs
+  void tick() {
+    if (remaining != 0 && --remaining != 0) {
+      return;  // Current element still running
+    }
+
+    Element e;
+    if (!queue.pop(e)) {
+      if (down) {
+        keyUp();
+      }
+      busy = false;
+      return;
+    }
+
+    busy = true;
+    remaining = e & durationMask;
+    if ((e & keyDown) && !down) {
+      keyDownNow();
+    } else if (!(e & keyDown) && down) {
+      keyUp();
+    }
+  }
+
+  const uint8_t ledPin;
+  volatile uint8_t brightness;
+#if MORSE_BUZZER
+  volatile unsigned int pitch;
+#endif
+
+private:
+  void keyDownNow() {
+    timerPwmWrite(ledPin, brightness);
+#if MORSE_BUZZER
+    sidetone.start(this, pitch);
+#endif
+    down = true;
+    MORSE_TRACE_EVENT(TRACE_KEY_ON, 0);
+    MORSE_TRACE_END(STAGE_KEY);
+  }
+
+  void keyUp() {
+    timerPwmWrite(ledPin, 0);
+#if MORSE_BUZZER
+    sidetone.stop(this);
+#endif
+    down = false;
+    MORSE_TRACE_EVENT(TRACE_KEY_OFF, 0);
+  }
+
+  SpscQueue<Element, 32> queue;
+  uint16_t remaining;  // Ticks left in the current element, ISR only
+  bool down;  // ISR only
+  volatile bool busy;
+};
+
+#endif
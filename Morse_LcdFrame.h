@@ -0,0 +1,159 @@
+/*
+   Shadow framebuffer for a 16x2 character LCD.
+
+   The sketch draws into frame with the same setCursor()/write()/print()
+   calls it would make on the LCD, which costs nothing but RAM. flush()
+   then compares frame with shown, the copy of what the LCD is displaying,
+   and sends only the cells that differ, moving the cursor only when the
+   next changed cell is not where the LCD's own address counter already
+   points. Appending one character to a line is therefore a single write,
+   and clear() never sends the 1.5 ms clear command: blanking the screen
+   just rewrites the cells that are not already blank.
+
+   Each command takes about 40us on the 4-bit bus, so flush() takes a limit
+   and can be called once per pass of loop() to spread a large update out.
+
+   NullLcdFrame has the same calls and does nothing, for builds without an
+   LCD (MORSE_LCD off).
+*/
+
+#ifndef MORSE_LCD_FRAME_H
+#define MORSE_LCD_FRAME_H
+
+#include "Morse_HAL.h"
+
+class LcdFrame {
+public:
+  static const uint8_t cols = 16;
+  static const uint8_t rows = 2;
+
+  explicit LcdFrame(LiquidCrystal& lcd) : lcd(lcd), col(0), row(0), lcdCol(noCursor), lcdRow(0) {
+    memset(frame, ' ', sizeof(frame));
+    memset(shown, ' ', sizeof(shown));
+    memset(dirty, 0, sizeof(dirty));
+  }
+
+  // Call after lcd.begin(), which leaves the display blank
+  void begin() {
+    memset(shown, ' ', sizeof(shown));
+    lcdCol = noCursor;
+    for (uint8_t r = 0; r < rows; r++) {
+      for (uint8_t c = 0; c < cols; c++) {
+        mark(c, r);
+      }
+    }
+  }
+
+  // Blank the whole frame and put the cursor top left
+  void clear() {
+    for (uint8_t r = 0; r < rows; r++) {
+      for (uint8_t c = 0; c < cols; c++) {
+        put(c, r, ' ');
+      }
+    }
+    col = 0;
+    row = 0;
+  }
+
+  void setCursor(uint8_t c, uint8_t r) {
+    col = c;
+    row = r < rows ? r : rows - 1;
+  }
+
+  // Characters past the end of the row are dropped, not wrapped
+  void write(char ch) {
+    if (col < cols) {
+      put(col, row, ch);
+      col++;
+    }
+  }
+
+  void print(const char* s) {
+    while (*s != '\0') {
+      write(*s++);
+    }
+  }
+
+  // Blank from the cursor to the end of its row
+  void clearToEnd() {
+    while (col < cols) {
+      write(' ');
+    }
+  }
+
+  bool changed() const {
+    for (uint8_t r = 0; r < rows; r++) {
+      if (dirty[r] != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Send changed cells to the LCD, using at most maxCommands cursor moves
+  // and writes. Returns true once the LCD matches the frame.
+  bool flush(uint8_t maxCommands = 255) {
+    for (uint8_t r = 0; r < rows; r++) {
+      for (uint8_t c = 0; dirty[r] != 0 && c < cols; c++) {
+        if (!(dirty[r] & (1U << c))) {
+          continue;
+        }
+        bool move = lcdCol != c || lcdRow != r;
+        if (maxCommands < (move ? 2 : 1)) {
+          return false;
+        }
+        if (move) {
+          lcd.setCursor(c, r);
+          maxCommands--;
+        }
+        lcd.write(frame[r][c]);
+        maxCommands--;
+        shown[r][c] = frame[r][c];
+        dirty[r] &= ~(1U << c);
+        lcdCol = c + 1;  // The LCD advances its address counter itself
+        lcdRow = r;
+      }
+    }
+    return true;
+  }
+
+private:
+  static const uint8_t noCursor = 0xFF;  // Cursor position unknown
+
+  void put(uint8_t c, uint8_t r, char ch) {
+    frame[r][c] = ch;
+    mark(c, r);
+  }
+
+  void mark(uint8_t c, uint8_t r) {
+    if (frame[r][c] != shown[r][c]) {
+      dirty[r] |= 1U << c;
+    } else {
+      dirty[r] &= ~(1U << c);
+    }
+  }
+
+  LiquidCrystal& lcd;
+  char frame[rows][cols];  // What the sketch wants shown
+  char shown[rows][cols];  // What the LCD is showing
+  uint16_t dirty[rows];  // Bit c set when frame and shown differ at column c
+  uint8_t col;  // Drawing cursor in the frame
+  uint8_t row;
+  uint8_t lcdCol;  // Where the LCD's address counter points
+  uint8_t lcdRow;
+};
+
+// Stands in for LcdFrame when there is no LCD; every call compiles away
+class NullLcdFrame {
+public:
+  void begin() {}
+  void clear() {}
+  void setCursor(uint8_t, uint8_t) {}
+  void write(char) {}
+  void print(const char*) {}
+  void clearToEnd() {}
+  bool changed() const { return false; }
+  bool flush(uint8_t = 255) { return true; }
+};
+
+#endif
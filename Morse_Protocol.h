@@ -0,0 +1,199 @@
+/*
+   Framed binary protocol, for driving the sketch from a program rather
+   than a serial monitor.
+
+   A frame is
+
+     STX  length  type  seq  payload...  crc-high  crc-low
+
+   where length counts the payload bytes (at most framePayloadMax) and the
+   CRC is CRC-16/CCITT-FALSE over length, type, seq and payload. Between
+   STX and the end of the frame, the bytes STX, DLE, XON and XOFF are sent
+   as DLE followed by the byte xor 0x20. So STX always starts a frame, and
+   XON/XOFF on the line are always flow control. Typed text never contains
+   STX, so text and frames can share the line.
+
+   Every request is answered with a frame carrying the same seq: FRAME_ACK,
+   FRAME_NAK with a FrameError, or FRAME_STATUS_REPLY. A sender that waits
+   for each answer, and resends after a NAK or a timeout, cannot overrun
+   the text queue. Multi-byte values are big-endian.
+
+   Nothing here depends on the board, so host programs use it too.
+*/
+
+#ifndef MORSE_PROTOCOL_H
+#define MORSE_PROTOCOL_H
+
+#include "Morse_HAL.h"
+
+const uint8_t frameStx = 0x02;
+const uint8_t frameDle = 0x10;
+const uint8_t framePayloadMax = 64;
+const unsigned long frameTimeoutMs = 100;  // A frame that stalls this long is dropped
+
+enum FrameType : uint8_t {
+  FRAME_TEXT = 0x01,            // UTF-8 text to queue for keying
+  FRAME_SET_WPM = 0x02,         // Character WPM, then effective WPM (0 = the same)
+  FRAME_SET_PITCH = 0x03,       // Tone in Hz, 16 bits
+  FRAME_SET_BRIGHTNESS = 0x04,  // LED level 0-255
+  FRAME_STATUS = 0x05,          // Answered with FRAME_STATUS_REPLY
+  FRAME_ABORT = 0x06,           // Drop all queued text and stop keying now
+  FRAME_SET_CHANNEL = 0x07,     // Channel the other requests apply to from now on
+  FRAME_SET_VOLUME = 0x08,      // Sidetone level 0-255, for every channel
+
+  FRAME_ACK = 0x80,             // Free space in the text queue, 16 bits
+  FRAME_NAK = 0x81,             // A FrameError
+  FRAME_STATUS_REPLY = 0x85     // See the sketch's sendStatus()
+};
+
+enum FrameError : uint8_t {
+  FRAME_BAD_CRC = 1,
+  FRAME_BAD_LENGTH,
+  FRAME_UNKNOWN_TYPE,
+  FRAME_QUEUE_FULL,  // Nothing was queued; send the text again later
+  FRAME_BAD_VALUE
+};
+
+inline uint16_t crc16Update(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+inline bool frameNeedsEscape(uint8_t b) {
+  return b == frameStx || b == frameDle || b == 0x11 || b == 0x13;
+}
+
+// Send one frame to out, which must have write(uint8_t)
+template <typename Out>
+void frameSend(Out& out, uint8_t type, uint8_t seq, const uint8_t* payload, uint8_t length) {
+  uint8_t header[3] = { length, type, seq };
+  uint16_t crc = 0xFFFF;
+  out.write(frameStx);
+  for (uint8_t i = 0; i < 3 + length + 2; i++) {
+    uint8_t b;
+    if (i < 3) {
+      b = header[i];
+    } else if (i < 3 + length) {
+      b = payload[i - 3];
+    } else {
+      b = i == 3 + length ? crc >> 8 : crc & 0xFF;
+    }
+    if (i < 3 + length) {
+      crc = crc16Update(crc, b);
+    }
+    if (frameNeedsEscape(b)) {
+      out.write(frameDle);
+      b ^= 0x20;
+    }
+    out.write(b);
+  }
+}
+
+// Assembles incoming frames a byte at a time
+class FrameReader {
+public:
+  enum Result : uint8_t {
+    READ_MORE,    // Frame not complete yet
+    READ_FRAME,   // type, seq, length and payload hold a good frame
+    READ_ERROR    // Frame was bad; error says why and seq is the best guess
+  };
+
+  FrameReader() : type(0), seq(0), length(0), error(0), state(IDLE), escaped(false), lastMs(0) {}
+
+  // True between a frame's STX and its last byte
+  bool active() const {
+    return state != IDLE;
+  }
+
+  Result feed(uint8_t b, unsigned long nowMs) {
+    if (state != IDLE && nowMs - lastMs > frameTimeoutMs) {
+      state = IDLE;  // The rest of that frame is never coming
+    }
+    lastMs = nowMs;
+
+    if (b == frameStx) {
+      state = LENGTH;  // Always a fresh start, even mid-frame
+      escaped = false;
+      crc = 0xFFFF;
+      return READ_MORE;
+    }
+    if (state == IDLE) {
+      return READ_MORE;
+    }
+    if (b == frameDle && !escaped) {
+      escaped = true;
+      return READ_MORE;
+    }
+    if (escaped) {
+      b ^= 0x20;
+      escaped = false;
+    }
+
+    switch (state) {
+      case LENGTH:
+        length = b;
+        crc = crc16Update(crc, b);
+        if (length > framePayloadMax) {
+          state = IDLE;
+          error = FRAME_BAD_LENGTH;
+          seq = 0;
+          return READ_ERROR;
+        }
+        state = TYPE;
+        break;
+      case TYPE:
+        type = b;
+        crc = crc16Update(crc, b);
+        state = SEQ;
+        break;
+      case SEQ:
+        seq = b;
+        crc = crc16Update(crc, b);
+        received = 0;
+        state = length > 0 ? PAYLOAD : CRC_HIGH;
+        break;
+      case PAYLOAD:
+        payload[received++] = b;
+        crc = crc16Update(crc, b);
+        if (received == length) {
+          state = CRC_HIGH;
+        }
+        break;
+      case CRC_HIGH:
+        crcHigh = b;
+        state = CRC_LOW;
+        break;
+      case CRC_LOW:
+        state = IDLE;
+        if ((((uint16_t)crcHigh << 8) | b) != crc) {
+          error = FRAME_BAD_CRC;
+          return READ_ERROR;
+        }
+        return READ_FRAME;
+      default:
+        break;
+    }
+    return READ_MORE;
+  }
+
+  uint8_t type;
+  uint8_t seq;
+  uint8_t length;
+  uint8_t payload[framePayloadMax];
+  uint8_t error;
+
+private:
+  enum State : uint8_t { IDLE, LENGTH, TYPE, SEQ, PAYLOAD, CRC_HIGH, CRC_LOW };
+
+  State state;
+  bool escaped;
+  uint8_t received;
+  uint8_t crcHigh;
+  uint16_t crc;
+  unsigned long lastMs;
+};
+
+#endif
@@ -0,0 +1,63 @@
+/*
+   Fixed-size character ring buffer.
+
+   The storage is part of the object, so a buffer never touches the heap
+   and its footprint is the same however much text passes through it.
+   push() refuses new characters when the buffer is full; pushOverwrite()
+   drops the oldest character instead, which suits a scrolling display.
+*/
+
+#ifndef MORSE_RING_BUFFER_H
+#define MORSE_RING_BUFFER_H
+
+#include "Morse_HAL.h"
+
+template <unsigned int Size>
+class CharRing {
+public:
+  CharRing() : head(0), used(0) {}
+
+  unsigned int count() const { return used; }
+  unsigned int capacity() const { return Size; }
+  bool empty() const { return used == 0; }
+  bool full() const { return used == Size; }
+  void clear() { head = 0; used = 0; }
+
+  // Adds c at the back, or returns false if there is no room
+  bool push(char c) {
+    if (used == Size) {
+      return false;
+    }
+    data[(head + used) % Size] = c;
+    used++;
+    return true;
+  }
+
+  // Adds c at the back, dropping the oldest character if the buffer is full
+  void pushOverwrite(char c) {
+    if (used == Size) {
+      pop();
+    }
+    push(c);
+  }
+
+  // Removes and returns the oldest character; the buffer must not be empty
+  char pop() {
+    char c = data[head];
+    head = (head + 1) % Size;
+    used--;
+    return c;
+  }
+
+  // The i-th oldest character, 0 <= i < count()
+  char peek(unsigned int i) const {
+    return data[(head + i) % Size];
+  }
+
+private:
+  char data[Size];
+  unsigned int head;  // Index of the oldest character
+  unsigned int used;
+};
+
+#endif
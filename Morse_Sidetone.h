@@ -0,0 +1,188 @@
+/*
+   Sine-wave sidetone on pin 3, in place of tone().
+
+   Timer2 runs phase-correct PWM on OC2B at about 31 kHz, well above
+   hearing, and its overflow interrupt works out one sample per PWM cycle:
+   a 16-bit phase accumulator steps through a 256-entry sine table at the
+   pitch, and the sample is scaled by an envelope that ramps up over rampMs
+   when the key goes down and back to silence after it comes up. The ramps
+   take the clicks out of the keying that a square wave switched on and
+   off has, and the pitch and volume can change at any time, even in the
+   middle of a mark. A speaker or piezo on pin 3 wants a capacitor in
+   series and, for a cleaner tone, a simple RC low-pass in front of it.
+
+   The interrupt does one table read, one 8x8 multiply and a few adds,
+   around 60 cycles with its prologue, and it only runs while a tone sounds
+   or dies away. Between marks the output rests at the midpoint, 128, so
+   starting and stopping is silent and costs no CPU.
+
+   As with tone(), there is one generator: the first keyer to key down
+   holds it until it keys up, and any keying down meanwhile lights its LED
+   without sounding.
+
+   tone() used Timer2 too, so the two cannot be mixed. OC2A, pin 11, stays
+   a plain output for the LCD's enable line, and the LCD's D6 line has moved
+   from pin 3 to A3 to make room.
+
+   On the host the interrupt runs on the virtual clock and hands each
+   sample to sim::audioSample(), so morse_sim --wav can write out exactly
+   what pin 3 would play.
+*/
+
+#ifndef MORSE_SIDETONE_H
+#define MORSE_SIDETONE_H
+
+#include "Morse_HAL.h"
+
+const uint8_t sidetonePin = 3;  // OC2B
+const unsigned int minPitch = 31;  // As low as tone() went
+const unsigned int maxPitch = 4000;  // Still a clean sine at this sample rate
+
+#ifdef ARDUINO
+const uint16_t sidetoneRateHz = F_CPU / 510;  // Phase-correct 8-bit PWM, clk/1
+#else
+const uint32_t sidetoneSampleUs = 32;
+const uint16_t sidetoneRateHz = 1000000 / sidetoneSampleUs;
+#endif
+
+// One cycle of a sine, -127 to 127
+const int8_t sidetoneSine[256] PROGMEM = {
+  0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+  49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+  90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+  117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+  127, 127, 127, 127, 126, 126, 126, 125, 125, 124, 123, 122, 122, 121, 120, 118,
+  117, 116, 115, 113, 112, 111, 109, 107, 106, 104, 102, 100, 98, 96, 94, 92,
+  90, 88, 85, 83, 81, 78, 76, 73, 71, 68, 65, 63, 60, 57, 54, 51,
+  49, 46, 43, 40, 37, 34, 31, 28, 25, 22, 19, 16, 12, 9, 6, 3,
+  0, -3, -6, -9, -12, -16, -19, -22, -25, -28, -31, -34, -37, -40, -43, -46,
+  -49, -51, -54, -57, -60, -63, -65, -68, -71, -73, -76, -78, -81, -83, -85, -88,
+  -90, -92, -94, -96, -98, -100, -102, -104, -106, -107, -109, -111, -112, -113, -115, -116,
+  -117, -118, -120, -121, -122, -122, -123, -124, -125, -125, -126, -126, -126, -127, -127, -127,
+  -127, -127, -127, -127, -126, -126, -126, -125, -125, -124, -123, -122, -122, -121, -120, -118,
+  -117, -116, -115, -113, -112, -111, -109, -107, -106, -104, -102, -100, -98, -96, -94, -92,
+  -90, -88, -85, -83, -81, -78, -76, -73, -71, -68, -65, -63, -60, -57, -54, -51,
+  -49, -46, -43, -40, -37, -34, -31, -28, -25, -22, -19, -16, -12, -9, -6, -3,
+};
+
+// Starts and stops the sample interrupt
+void sidetoneRun(bool on);
+
+class Sidetone {
+public:
+  static const uint8_t rampMs = 4;
+  static const uint16_t rampStep = 0xFF00UL * 1000 / ((uint32_t)rampMs * sidetoneRateHz);
+
+  Sidetone() : volume(255), owner(NULL), step(0), phase(0), level(0), running(false) {}
+
+  // Sound hz for owner, unless another owner holds the generator. Called
+  // from the keying interrupt.
+  void start(const void* who, unsigned int hz) {
+    if (owner != NULL && owner != who) {
+      return;
+    }
+    owner = who;
+    step = stepFor(hz);
+    if (!running) {
+      running = true;
+      phase = 0;
+      sidetoneRun(true);
+    }
+  }
+
+  // Let the tone die away, if owner holds the generator
+  void stop(const void* who) {
+    if (owner == who) {
+      owner = NULL;
+    }
+  }
+
+  // Change owner's pitch, at once if it is sounding. Called from loop().
+  void setPitch(const void* who, unsigned int hz) {
+    uint16_t s = stepFor(hz);
+    noInterrupts();
+    if (owner == who) {
+      step = s;
+    }
+    interrupts();
+  }
+
+  // The next sample, 0-255. Called from the sample interrupt.
+  uint8_t nextSample() {
+    uint16_t peak = volume << 8;
+    if (owner != NULL && level < peak) {
+      level = peak - level > rampStep ? level + rampStep : peak;
+    } else if (owner == NULL || level > peak) {
+      uint16_t floor = owner == NULL ? 0 : peak;
+      level = level - floor > rampStep ? level - rampStep : floor;
+      if (level == 0 && owner == NULL) {
+        running = false;
+        sidetoneRun(false);
+      }
+    }
+    int8_t s = pgm_read_byte(&sidetoneSine[phase >> 8]);
+    phase += step;
+    return 128 + ((s * (level >> 8)) >> 8);
+  }
+
+  volatile uint8_t volume;  // Peak level, 0-255
+
+private:
+  static uint16_t stepFor(unsigned int hz) {
+    return (uint32_t)hz * 65536 / sidetoneRateHz;
+  }
+
+  const void* volatile owner;  // Keyer holding the generator, or NULL while the tone dies away
+  volatile uint16_t step;  // Phase step per sample, from the pitch
+  uint16_t phase;
+  uint16_t level;  // Envelope, volume << 8 at full, interrupt only
+  volatile bool running;  // The sample interrupt is on
+};
+
+Sidetone sidetone;
+
+#ifdef ARDUINO
+
+ISR(TIMER2_OVF_vect) {
+  OCR2B = sidetone.nextSample();
+}
+
+void sidetoneRun(bool on) {
+  if (on) {
+    TIMSK2 = _BV(TOIE2);
+  } else {
+    TIMSK2 = 0;
+    OCR2B = 128;
+  }
+}
+
+inline void sidetoneBegin() {
+  pinMode(sidetonePin, OUTPUT);
+  TCCR2A = _BV(COM2B1) | _BV(WGM20);  // Phase-correct PWM on OC2B only
+  TCCR2B = _BV(CS20);  // clk/1
+  OCR2B = 128;
+}
+
+#else
+
+inline void sidetoneInterrupt() {
+  sim::audioSample(sidetone.nextSample());
+}
+
+void sidetoneRun(bool on) {
+  if (on) {
+    sim::attachTimer(sidetoneSampleUs, sidetoneInterrupt);
+  } else {
+    sim::detachTimer(sidetoneInterrupt);
+    sim::audioSample(128);
+  }
+}
+
+inline void sidetoneBegin() {
+  pinMode(sidetonePin, OUTPUT);
+  sim::audioSample(128);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+/*
+   Idle sleep for the spare time between passes of loop().
+
+   sleepIdle() puts the MCU in IDLE mode, which stops the CPU clock but
+   leaves the timers and the UART running, so the next interrupt wakes it:
+   the 1 ms keying tick, Timer0's millis() tick or a byte arriving on RX.
+   Keying is done entirely in the Timer1 interrupt, so sleeping never moves
+   an element edge, and a byte that arrives just before the sleep starts is
+   picked up at the next tick at the latest.
+
+   sleepBegin() turns off the ADC, SPI and TWI, which the sketch never uses,
+   to cut the idle current further.
+
+   On the host, sleepIdle() moves the virtual clock on to the next interrupt
+   and counts the time as asleep, for the simulator's duty cycle report.
+*/
+
+#ifndef MORSE_SLEEP_H
+#define MORSE_SLEEP_H
+
+#include "Morse_HAL.h"
+
+#ifdef ARDUINO
+
+#include <avr/power.h>
+#include <avr/sleep.h>
+
+inline void sleepBegin() {
+  ADCSRA &= ~_BV(ADEN);  // The ADC must be off before its clock is stopped
+  power_adc_disable();
+  power_spi_disable();
+  power_twi_disable();
+}
+
+inline void sleepIdle() {
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+}
+
+#else
+
+inline void sleepBegin() {}
+
+inline void sleepIdle() {
+  sim::sleepUntilInterrupt();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,285 @@
+/*
+   Named message slots in EEPROM, encoded for keying when they are saved.
+
+   #save turns a line of text into elements once; #play and #beacon then
+   key the slot straight from EEPROM, with no table lookups and no host
+   attached. A slot holds two-bit symbols, four to a byte, first symbol in
+   the top bits:
+
+     0  dot, then the gap between elements
+     1  dash, then the gap between elements
+     2  end of a letter: stretch the last gap to a letter gap
+     3  end of a word: stretch the letter gap to a word gap
+
+   The symbols count units rather than milliseconds, so a slot plays at
+   whatever speed its channel is set to, Farnsworth spacing included.
+
+   Layout of the EEPROM. Blank EEPROM reads 0xFF, which is an empty slot
+   and no beacon, so a new board needs no formatting:
+
+     0     beacon slot, or 0xFF
+     1     beacon pause in seconds (2 bytes, big-endian)
+     8     slotCount slots of slotSize bytes, each a name (nameLength
+           bytes, 0-padded), its symbol count (2 bytes) and the symbols
+
+   An EEPROM write takes 3.4 ms, so writes wait in a short queue and
+   pump() starts the next one whenever the EEPROM is free; only a write
+   made with the queue already full waits. A slot's name is written last,
+   so a save cut short by a reset leaves the slot empty, not half saved.
+*/
+
+#ifndef MORSE_SLOTS_H
+#define MORSE_SLOTS_H
+
+#include "Morse_HAL.h"
+#include "Morse_Table.h"
+
+#ifdef ARDUINO
+#include <avr/eeprom.h>
+#endif
+
+enum SlotSymbol : uint8_t {
+  SLOT_DOT = 0,
+  SLOT_DASH = 1,
+  SLOT_LETTER_END = 2,
+  SLOT_WORD_END = 3
+};
+
+class MessageSlots {
+public:
+  static const uint8_t slotCount = 4;
+  static const uint8_t nameLength = 8;
+  static const uint16_t slotSize = 254;
+  static const uint16_t maxSymbols = (slotSize - nameLength - 2) * 4;
+  static const int noSlot = -1;
+  static const int endOfSlot = -1;
+
+  MessageSlots() : writeHead(0), writeCount(0), saveSlot(noSlot), saveCount(0), saveByte(0), saveFull(false), playSlot(noSlot), playAt(0), playCount(0) {}
+
+  // Slot holding name, or noSlot
+  int find(const char* name) const {
+    for (uint8_t slot = 0; slot < slotCount; slot++) {
+      char stored[nameLength + 1];
+      if (getName(slot, stored) && strcmp(stored, name) == 0) {
+        return slot;
+      }
+    }
+    return noSlot;
+  }
+
+  // First empty slot, or noSlot
+  int freeSlot() const {
+    for (uint8_t slot = 0; slot < slotCount; slot++) {
+      if (read(slotBase(slot)) == 0xFF) {
+        return slot;
+      }
+    }
+    return noSlot;
+  }
+
+  // Copy slot's name into name, which must hold nameLength + 1 chars.
+  // Returns false if the slot is empty.
+  bool getName(uint8_t slot, char* name) const {
+    uint16_t base = slotBase(slot);
+    if (read(base) == 0xFF) {
+      return false;
+    }
+    for (uint8_t i = 0; i < nameLength; i++) {
+      name[i] = read(base + i);
+    }
+    name[nameLength] = '\0';
+    return true;
+  }
+
+  uint16_t symbols(uint8_t slot) const {
+    uint16_t base = slotBase(slot) + nameLength;
+    return (read(base) << 8) | read(base + 1);
+  }
+
+  void erase(uint8_t slot) {
+    if (beaconSlot() == slot) {
+      setBeacon(noSlot, 0);
+    }
+    queueWrite(slotBase(slot), 0xFF);
+  }
+
+  // The slot keyed again and again with no host attached, or noSlot
+  int beaconSlot() const {
+    uint8_t slot = read(0);
+    return slot < slotCount ? slot : noSlot;
+  }
+
+  uint16_t beaconPause() const {
+    return (read(1) << 8) | read(2);
+  }
+
+  void setBeacon(int slot, uint16_t pauseS) {
+    queueWrite(1, pauseS >> 8);
+    queueWrite(2, pauseS);
+    queueWrite(0, slot == noSlot ? 0xFF : slot);
+  }
+
+  // Saving. Start a save into slot, under name (at most nameLength
+  // chars), add the text's letters and word gaps one at a time, and
+  // endSave() at the end of the line. A letter queues at most three
+  // writes, so adding one only once writing() is false never waits.
+  void beginSave(uint8_t slot, const char* name) {
+    saveSlot = slot;
+    saveCount = 0;
+    saveByte = 0;
+    saveFull = false;
+    for (uint8_t i = 0; i < nameLength; i++) {
+      saveName[i] = *name != '\0' ? *name++ : '\0';
+    }
+    queueWrite(slotBase(slot), 0xFF);  // Empty until the name goes back at the end
+  }
+
+  bool saving() const {
+    return saveSlot != noSlot;
+  }
+
+  // The name being saved under, not 0-terminated if nameLength long
+  const char* savingName() const {
+    return saveName;
+  }
+
+  // Give up on the save, leaving the slot empty
+  void cancelSave() {
+    saveSlot = noSlot;
+  }
+
+  // Add the elements of a packed Morse code, then the letter gap
+  void addCode(uint8_t code) {
+    if (saveCount + 8 > maxSymbols) {
+      saveFull = true;  // Keep the slot to whole letters
+      return;
+    }
+    for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+      addSymbol((code & element) ? SLOT_DASH : SLOT_DOT);
+    }
+    addSymbol(SLOT_LETTER_END);
+  }
+
+  void addWordGap() {
+    if (saveCount < maxSymbols) {
+      addSymbol(SLOT_WORD_END);
+    } else {
+      saveFull = true;
+    }
+  }
+
+  // Finish the save. Returns the number of symbols saved; truncated() says
+  // whether the text was cut short for want of room.
+  uint16_t endSave() {
+    uint16_t base = slotBase(saveSlot);
+    if (saveCount % 4 != 0) {
+      queueWrite(symbolAddress(saveSlot, saveCount), saveByte << (2 * (4 - saveCount % 4)));
+    }
+    queueWrite(base + nameLength, saveCount >> 8);
+    queueWrite(base + nameLength + 1, saveCount);
+    for (uint8_t i = nameLength; i-- > 0; ) {
+      queueWrite(base + i, saveName[i]);
+    }
+    saveSlot = noSlot;
+    return saveCount;
+  }
+
+  bool truncated() const {
+    return saveFull;
+  }
+
+  // True while EEPROM writes are queued or in progress
+  bool writing() const {
+    return writeCount != 0 || !eeprom_is_ready();
+  }
+
+  // Start the next queued write if the EEPROM is free. Call on every pass
+  // of loop().
+  void pump() {
+    if (writeCount != 0 && eeprom_is_ready()) {
+      eeprom_update_byte((uint8_t*)(uintptr_t)writeAddress[writeHead], writeValue[writeHead]);
+      writeHead = (writeHead + 1) % maxWrites;
+      writeCount--;
+    }
+  }
+
+  // Playing. Reads one symbol at a time from slot.
+  void beginPlay(uint8_t slot) {
+    playSlot = slot;
+    playAt = 0;
+    playCount = symbols(slot);
+  }
+
+  bool playing() const {
+    return playSlot != noSlot;
+  }
+
+  int playingSlot() const {
+    return playSlot;
+  }
+
+  // The next symbol of the slot being played, or endOfSlot
+  int nextSymbol() {
+    if (playAt >= playCount) {
+      playSlot = noSlot;
+      return endOfSlot;
+    }
+    uint8_t b = read(symbolAddress(playSlot, playAt));
+    uint8_t shift = 2 * (3 - playAt % 4);
+    playAt++;
+    return (b >> shift) & 3;
+  }
+
+  void stopPlay() {
+    playSlot = noSlot;
+  }
+
+private:
+  static const uint8_t maxWrites = 16;  // Room for the end of a save
+
+  static uint16_t slotBase(uint8_t slot) {
+    return 8 + slot * slotSize;
+  }
+
+  static uint16_t symbolAddress(uint8_t slot, uint16_t symbol) {
+    return slotBase(slot) + nameLength + 2 + symbol / 4;
+  }
+
+  static uint8_t read(uint16_t address) {
+    return eeprom_read_byte((const uint8_t*)(uintptr_t)address);
+  }
+
+  void addSymbol(uint8_t symbol) {
+    saveByte = (saveByte << 2) | symbol;
+    saveCount++;
+    if (saveCount % 4 == 0) {
+      queueWrite(symbolAddress(saveSlot, saveCount - 1), saveByte);
+      saveByte = 0;
+    }
+  }
+
+  void queueWrite(uint16_t address, uint8_t value) {
+    while (writeCount == maxWrites) {
+      pump();
+    }
+    uint8_t i = (writeHead + writeCount) % maxWrites;
+    writeAddress[i] = address;
+    writeValue[i] = value;
+    writeCount++;
+  }
+
+  uint16_t writeAddress[maxWrites];
+  uint8_t writeValue[maxWrites];
+  uint8_t writeHead;  // Oldest queued write
+  uint8_t writeCount;
+  int8_t saveSlot;
+  uint16_t saveCount;
+  uint8_t saveByte;  // Symbols not yet written, in the low bits
+  bool saveFull;
+  char saveName[nameLength];
+  int8_t playSlot;
+  uint16_t playAt;
+  uint16_t playCount;
+};
+
+#endif
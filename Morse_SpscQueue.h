@@ -0,0 +1,59 @@
+/*
+   Lock-free single-producer/single-consumer queue.
+
+   One side (normally loop()) only ever calls push() and the other (an
+   interrupt handler) only ever calls pop(). Each side writes just its own
+   8-bit index, and single byte stores are atomic on the AVR, so neither
+   side has to disable interrupts. The indices run freely and wrap at 256,
+   which is why Size must be a power of two no larger than 128.
+*/
+
+#ifndef MORSE_SPSC_QUEUE_H
+#define MORSE_SPSC_QUEUE_H
+
+#include "Morse_HAL.h"
+
+template <typename T, uint8_t Size>
+class SpscQueue {
+  static_assert(Size != 0 && (Size & (Size - 1)) == 0 && Size <= 128, "Size must be a power of two up to 128");
+
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  // Producer side. Returns false if the queue is full.
+  bool push(T value) {
+    uint8_t h = head;
+    if ((uint8_t)(h - tail) == Size) {
+      return false;
+    }
+    data[h & (Size - 1)] = value;
+    head = h + 1;  // Publish only after the slot is written
+    return true;
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool pop(T& value) {
+    uint8_t t = tail;
+    if (t == head) {
+      return false;
+    }
+    value = data[t & (Size - 1)];
+    tail = t + 1;  // Hand the slot back only after it is read
+    return true;
+  }
+
+  // Safe to call from either side; the answer may be stale by one entry
+  uint8_t count() const { return (uint8_t)(head - tail); }
+  uint8_t space() const { return Size - count(); }
+  bool empty() const { return head == tail; }
+
+  // Consumer side: drop everything queued
+  void clear() { tail = head; }
+
+private:
+  volatile T data[Size];
+  volatile uint8_t head;  // Written only by the producer
+  volatile uint8_t tail;  // Written only by the consumer
+};
+
+#endif
@@ -0,0 +1,278 @@
+/*
+   Morse code tables, packed one byte per symbol and kept in flash.
+
+   Each byte holds a 1 marker bit followed by one bit per element, first
+   element highest, dash = 1. "-.-" packs to 0b1101 and "." to 0b10, so
+   up to 7 elements fit and the element count is the marker position.
+   The codes are written as dot/dash strings below; morsePack() turns them
+   into bytes at compile time.
+
+   There are four alphabets, each an 8-bit code page: bytes below 0x80 are
+   ASCII in all of them, and the upper half holds the alphabet's letters
+   in the standard single-byte encoding for that script:
+
+     MORSE_LATIN     ISO 8859-1, for the accented letters
+     MORSE_CYRILLIC  Windows-1251, with the Russian codes
+     MORSE_GREEK     ISO 8859-7
+     MORSE_WABUN     JIS X 0201 half-width katakana, which is also what the
+                     HD44780's standard character ROM shows
+
+   Morse_Unicode.h converts UTF-8 input into these bytes. Lower case and
+   accented forms are listed after the letters they share a code with.
+
+   morseLookup[] maps every byte of every page straight to its packed code,
+   so encoding a character is a single flash read. It is generated from
+   the symbol lists at compile time, so the lists themselves take no space
+   in the finished sketch.
+
+   Read as a number, a packed code is also the position of its character
+   in a binary tree stored as an array: start at 1, go to 2i for a dot and
+   2i + 1 for a dash. morseTree[] holds that tree for each alphabet, built
+   at compile time by inverting the lists, so decoding needs no search at
+   all. An alphabet's own letters win over ASCII when both share a code,
+   except in MORSE_LATIN, where ASCII comes first.
+*/
+
+#ifndef MORSE_TABLE_H
+#define MORSE_TABLE_H
+
+#include "Morse_HAL.h"
+
+const uint8_t morseInvalid = 0;  // Returned for characters with no code
+
+constexpr uint8_t morsePack(const char* code, uint8_t bits = 1) {
+  return *code == '\0' ? bits : morsePack(code + 1, (uint8_t)((bits << 1) | (*code == '-' ? 1 : 0)));
+}
+
+enum MorseAlphabet : uint8_t {
+  MORSE_LATIN,
+  MORSE_CYRILLIC,
+  MORSE_GREEK,
+  MORSE_WABUN,
+  morseAlphabets
+};
+
+struct MorseSymbol {
+  uint8_t c;
+  uint8_t code;
+};
+
+// Letters, digits and the ITU punctuation, shared by every alphabet
+constexpr MorseSymbol morseAscii[] PROGMEM = {
+  { 'A', morsePack(".-") }, { 'B', morsePack("-...") }, { 'C', morsePack("-.-.") }, { 'D', morsePack("-..") },
+  { 'E', morsePack(".") }, { 'F', morsePack("..-.") }, { 'G', morsePack("--.") }, { 'H', morsePack("....") },
+  { 'I', morsePack("..") }, { 'J', morsePack(".---") }, { 'K', morsePack("-.-") }, { 'L', morsePack(".-..") },
+  { 'M', morsePack("--") }, { 'N', morsePack("-.") }, { 'O', morsePack("---") }, { 'P', morsePack(".--.") },
+  { 'Q', morsePack("--.-") }, { 'R', morsePack(".-.") }, { 'S', morsePack("...") }, { 'T', morsePack("-") },
+  { 'U', morsePack("..-") }, { 'V', morsePack("...-") }, { 'W', morsePack(".--") }, { 'X', morsePack("-..-") },
+  { 'Y', morsePack("-.--") }, { 'Z', morsePack("--..") },
+  { '0', morsePack("-----") }, { '1', morsePack(".----") }, { '2', morsePack("..---") }, { '3', morsePack("...--") },
+  { '4', morsePack("....-") }, { '5', morsePack(".....") }, { '6', morsePack("-....") }, { '7', morsePack("--...") },
+  { '8', morsePack("---..") }, { '9', morsePack("----.") },
+  { '.', morsePack(".-.-.-") }, { ',', morsePack("--..--") }, { '?', morsePack("..--..") }, { '\'', morsePack(".----.") },
+  { '!', morsePack("-.-.--") }, { '/', morsePack("-..-.") }, { '(', morsePack("-.--.") }, { ')', morsePack("-.--.-") },
+  { '&', morsePack(".-...") }, { ':', morsePack("---...") }, { ';', morsePack("-.-.-.") }, { '=', morsePack("-...-") },
+  { '+', morsePack(".-.-.") }, { '-', morsePack("-....-") }, { '_', morsePack("..--.-") }, { '"', morsePack(".-..-.") },
+  { '$', morsePack("...-..-") }, { '@', morsePack(".--.-.") }
+};
+
+// ISO 8859-1 letters with codes of their own
+constexpr MorseSymbol morseLatin1[] PROGMEM = {
+  { 0xC0, morsePack(".--.-") },   // A grave
+  { 0xC4, morsePack(".-.-") },    // A diaeresis
+  { 0xC7, morsePack("-.-..") },   // C cedilla
+  { 0xC8, morsePack(".-..-") },   // E grave
+  { 0xC9, morsePack("..-..") },   // E acute
+  { 0xD0, morsePack("..--.") },   // Eth
+  { 0xD1, morsePack("--.--") },   // N tilde
+  { 0xD6, morsePack("---.") },    // O diaeresis
+  { 0xDC, morsePack("..--") },    // U diaeresis
+  { 0xDE, morsePack(".--..") },   // Thorn
+  { 0xDF, morsePack("...--..") },  // Sharp s
+  { 0xC5, morsePack(".--.-") },   // A ring, as A grave
+  { 0xC6, morsePack(".-.-") },    // AE, as A diaeresis
+  { 0xD8, morsePack("---.") }     // O stroke, as O diaeresis
+};
+
+// Windows-1251 Russian letters, upper case from 0xC0 in alphabetical order
+constexpr MorseSymbol morseCyrillic[] PROGMEM = {
+  { 0xC0, morsePack(".-") }, { 0xC1, morsePack("-...") }, { 0xC2, morsePack(".--") }, { 0xC3, morsePack("--.") },
+  { 0xC4, morsePack("-..") }, { 0xC5, morsePack(".") }, { 0xC6, morsePack("...-") }, { 0xC7, morsePack("--..") },
+  { 0xC8, morsePack("..") }, { 0xC9, morsePack(".---") }, { 0xCA, morsePack("-.-") }, { 0xCB, morsePack(".-..") },
+  { 0xCC, morsePack("--") }, { 0xCD, morsePack("-.") }, { 0xCE, morsePack("---") }, { 0xCF, morsePack(".--.") },
+  { 0xD0, morsePack(".-.") }, { 0xD1, morsePack("...") }, { 0xD2, morsePack("-") }, { 0xD3, morsePack("..-") },
+  { 0xD4, morsePack("..-.") }, { 0xD5, morsePack("....") }, { 0xD6, morsePack("-.-.") }, { 0xD7, morsePack("---.") },
+  { 0xD8, morsePack("----") }, { 0xD9, morsePack("--.-") }, { 0xDA, morsePack("--.--") }, { 0xDB, morsePack("-.--") },
+  { 0xDC, morsePack("-..-") }, { 0xDD, morsePack("..-..") }, { 0xDE, morsePack("..--") }, { 0xDF, morsePack(".-.-") },
+  { 0xA8, morsePack(".") },  // Yo, as Ye
+  { 0xB8, morsePack(".") }   // yo
+};
+
+// ISO 8859-7 Greek letters, upper case from 0xC1
+constexpr MorseSymbol morseGreek[] PROGMEM = {
+  { 0xC1, morsePack(".-") }, { 0xC2, morsePack("-...") }, { 0xC3, morsePack("--.") }, { 0xC4, morsePack("-..") },
+  { 0xC5, morsePack(".") }, { 0xC6, morsePack("--..") }, { 0xC7, morsePack("....") }, { 0xC8, morsePack("-.-.") },
+  { 0xC9, morsePack("..") }, { 0xCA, morsePack("-.-") }, { 0xCB, morsePack(".-..") }, { 0xCC, morsePack("--") },
+  { 0xCD, morsePack("-.") }, { 0xCE, morsePack("-..-") }, { 0xCF, morsePack("---") }, { 0xD0, morsePack(".--.") },
+  { 0xD1, morsePack(".-.") }, { 0xD3, morsePack("...") }, { 0xD4, morsePack("-") }, { 0xD5, morsePack("-.--") },
+  { 0xD6, morsePack("..-.") }, { 0xD7, morsePack("----") }, { 0xD8, morsePack("--.-") }, { 0xD9, morsePack(".--") },
+  // Accented and final forms, as the plain letter
+  { 0xB6, morsePack(".-") }, { 0xB8, morsePack(".") }, { 0xB9, morsePack("....") }, { 0xBA, morsePack("..") },
+  { 0xBC, morsePack("---") }, { 0xBE, morsePack("-.--") }, { 0xBF, morsePack(".--") }, { 0xC0, morsePack("..") },
+  { 0xDA, morsePack("..") }, { 0xDB, morsePack("-.--") }, { 0xDC, morsePack(".-") }, { 0xDD, morsePack(".") },
+  { 0xDE, morsePack("....") }, { 0xDF, morsePack("..") }, { 0xE0, morsePack("-.--") }, { 0xF2, morsePack("...") },
+  { 0xFA, morsePack("..") }, { 0xFB, morsePack("-.--") }, { 0xFC, morsePack("---") }, { 0xFD, morsePack("-.--") },
+  { 0xFE, morsePack(".--") }
+};
+
+// JIS X 0201 katakana in iroha order. The obsolete wi and we have no
+// half-width form and so no byte here.
+constexpr MorseSymbol morseWabun[] PROGMEM = {
+  { 0xB2, morsePack(".-") }, { 0xDB, morsePack(".-.-") }, { 0xCA, morsePack("-...") }, { 0xC6, morsePack("-.-.") },
+  { 0xCE, morsePack("-..") }, { 0xCD, morsePack(".") }, { 0xC4, morsePack("..-..") }, { 0xC1, morsePack("..-.") },
+  { 0xD8, morsePack("--.") }, { 0xC7, morsePack("....") }, { 0xD9, morsePack("-.--.") }, { 0xA6, morsePack(".---") },
+  { 0xDC, morsePack("-.-") }, { 0xB6, morsePack(".-..") }, { 0xD6, morsePack("--") }, { 0xC0, morsePack("-.") },
+  { 0xDA, morsePack("---") }, { 0xBF, morsePack("---.") }, { 0xC2, morsePack(".--.") }, { 0xC8, morsePack("--.-") },
+  { 0xC5, morsePack(".-.") }, { 0xD7, morsePack("...") }, { 0xD1, morsePack("-") }, { 0xB3, morsePack("..-") },
+  { 0xC9, morsePack("..--") }, { 0xB5, morsePack(".-...") }, { 0xB8, morsePack("...-") }, { 0xD4, morsePack(".--") },
+  { 0xCF, morsePack("-..-") }, { 0xB9, morsePack("-.--") }, { 0xCC, morsePack("--..") }, { 0xBA, morsePack("----") },
+  { 0xB4, morsePack("-.---") }, { 0xC3, morsePack(".-.--") }, { 0xB1, morsePack("--.--") }, { 0xBB, morsePack("-.-.-") },
+  { 0xB7, morsePack("-.-..") }, { 0xD5, morsePack("-..--") }, { 0xD2, morsePack("-...-") }, { 0xD0, morsePack("..-.-") },
+  { 0xBC, morsePack("--.-.") }, { 0xCB, morsePack("--..-") }, { 0xD3, morsePack("-..-.") }, { 0xBE, morsePack(".---.") },
+  { 0xBD, morsePack("---.-") }, { 0xDD, morsePack(".-.-.") },
+  { 0xDE, morsePack("..") },      // Dakuten, sent after the kana it voices
+  { 0xDF, morsePack("..--.") },   // Handakuten
+  { 0xB0, morsePack(".--.-") },   // Long vowel mark
+  { 0xA4, morsePack(".-.-.-") },  // Comma
+  { 0xA3, morsePack(".-.-..") },  // Closing bracket
+  // Small kana, as the full size ones
+  { 0xA7, morsePack("--.--") }, { 0xA8, morsePack(".-") }, { 0xA9, morsePack("..-") }, { 0xAA, morsePack("-.---") },
+  { 0xAB, morsePack(".-...") }, { 0xAC, morsePack(".--") }, { 0xAD, morsePack("-..--") }, { 0xAE, morsePack("--") },
+  { 0xAF, morsePack(".--.") }
+};
+
+template <typename T, unsigned int N>
+constexpr uint8_t morseCount(const T (&)[N]) {
+  return N;
+}
+
+// Code of c in the n symbols from s, or morseInvalid
+constexpr uint8_t morseFind(const MorseSymbol* s, uint8_t n, uint8_t c) {
+  return n == 0 ? morseInvalid : s->c == c ? s->code : morseFind(s + 1, n - 1, c);
+}
+
+// First character with code in the n symbols from s, or 0
+constexpr uint8_t morseFindChar(const MorseSymbol* s, uint8_t n, uint8_t code) {
+  return n == 0 ? 0 : s->code == code ? s->c : morseFindChar(s + 1, n - 1, code);
+}
+
+constexpr uint8_t morseFindHigh(uint8_t alphabet, uint8_t c) {
+  return alphabet == MORSE_LATIN ? morseFind(morseLatin1, morseCount(morseLatin1), c) :
+         alphabet == MORSE_CYRILLIC ? morseFind(morseCyrillic, morseCount(morseCyrillic), c) :
+         alphabet == MORSE_GREEK ? morseFind(morseGreek, morseCount(morseGreek), c) :
+         morseFind(morseWabun, morseCount(morseWabun), c);
+}
+
+constexpr uint8_t morseFindHighChar(uint8_t alphabet, uint8_t code) {
+  return alphabet == MORSE_LATIN ? morseFindChar(morseLatin1, morseCount(morseLatin1), code) :
+         alphabet == MORSE_CYRILLIC ? morseFindChar(morseCyrillic, morseCount(morseCyrillic), code) :
+         alphabet == MORSE_GREEK ? morseFindChar(morseGreek, morseCount(morseGreek), code) :
+         morseFindChar(morseWabun, morseCount(morseWabun), code);
+}
+
+// Upper case of c. In the 8-bit pages other than JIS X 0201, lower case
+// sits 0x20 above upper case from 0xE0 (sharp s and y diaeresis aside).
+constexpr uint8_t morseUpper(uint8_t alphabet, uint8_t c) {
+  return (c >= 'a' && c <= 'z') ? c - 0x20 :
+         (c >= 0xE0 && alphabet != MORSE_WABUN && !(alphabet == MORSE_LATIN && c == 0xFF)) ? c - 0x20 :
+         c;
+}
+
+constexpr uint8_t morseForByte(uint8_t alphabet, uint8_t c) {
+  return c < 0x80 ? morseFind(morseAscii, morseCount(morseAscii), morseUpper(alphabet, c)) :
+         morseFindHigh(alphabet, c) != morseInvalid ? morseFindHigh(alphabet, c) :
+         morseFindHigh(alphabet, morseUpper(alphabet, c));
+}
+
+constexpr uint8_t morseEither(uint8_t first, uint8_t second) {
+  return first != 0 ? first : second;
+}
+
+constexpr uint8_t morseCharForCode(uint8_t alphabet, uint8_t code) {
+  return alphabet == MORSE_LATIN ?
+    morseEither(morseFindChar(morseAscii, morseCount(morseAscii), code), morseFindHighChar(alphabet, code)) :
+    morseEither(morseFindHighChar(alphabet, code), morseFindChar(morseAscii, morseCount(morseAscii), code));
+}
+
+#define MORSE_ROW(f, a, hi) \
+  f(a, hi + 0x0), f(a, hi + 0x1), f(a, hi + 0x2), f(a, hi + 0x3), f(a, hi + 0x4), f(a, hi + 0x5), \
+  f(a, hi + 0x6), f(a, hi + 0x7), f(a, hi + 0x8), f(a, hi + 0x9), f(a, hi + 0xA), f(a, hi + 0xB), \
+  f(a, hi + 0xC), f(a, hi + 0xD), f(a, hi + 0xE), f(a, hi + 0xF)
+
+#define MORSE_PAGE(f, a) { \
+  MORSE_ROW(f, a, 0x00), MORSE_ROW(f, a, 0x10), MORSE_ROW(f, a, 0x20), MORSE_ROW(f, a, 0x30), \
+  MORSE_ROW(f, a, 0x40), MORSE_ROW(f, a, 0x50), MORSE_ROW(f, a, 0x60), MORSE_ROW(f, a, 0x70), \
+  MORSE_ROW(f, a, 0x80), MORSE_ROW(f, a, 0x90), MORSE_ROW(f, a, 0xA0), MORSE_ROW(f, a, 0xB0), \
+  MORSE_ROW(f, a, 0xC0), MORSE_ROW(f, a, 0xD0), MORSE_ROW(f, a, 0xE0), MORSE_ROW(f, a, 0xF0) }
+
+// Packed code for every byte value of every alphabet, morseInvalid where
+// there is none
+const uint8_t morseLookup[morseAlphabets][256] PROGMEM = {
+  MORSE_PAGE(morseForByte, MORSE_LATIN),
+  MORSE_PAGE(morseForByte, MORSE_CYRILLIC),
+  MORSE_PAGE(morseForByte, MORSE_GREEK),
+  MORSE_PAGE(morseForByte, MORSE_WABUN)
+};
+
+// Decoding trees: the character for every code of up to seven elements
+const uint8_t morseTree[morseAlphabets][256] PROGMEM = {
+  MORSE_PAGE(morseCharForCode, MORSE_LATIN),
+  MORSE_PAGE(morseCharForCode, MORSE_CYRILLIC),
+  MORSE_PAGE(morseCharForCode, MORSE_GREEK),
+  MORSE_PAGE(morseCharForCode, MORSE_WABUN)
+};
+
+#undef MORSE_PAGE
+#undef MORSE_ROW
+
+// Returns the character for a packed code, or 0 if no character has it
+inline char morseDecode(uint8_t code, uint8_t alphabet = MORSE_LATIN) {
+  return pgm_read_byte(&morseTree[alphabet][code]);
+}
+
+// Returns the packed Morse code for c, or morseInvalid if c has no mapping
+inline uint8_t morseEncode(char c, uint8_t alphabet = MORSE_LATIN) {
+  return pgm_read_byte(&morseLookup[alphabet][(uint8_t)c]);
+}
+
+// Mask selecting the first element of a packed code, 0 if it has none.
+// Shift the mask right after each element; the code ends when it hits 0.
+inline uint8_t morseFirstElement(uint8_t code) {
+  uint8_t mask = 0x80;
+  while (mask > code) {
+    mask >>= 1;  // Walk down to the marker bit
+  }
+  return mask >> 1;
+}
+
+// Number of dots and dashes in a packed code
+inline uint8_t morseLength(uint8_t code) {
+  uint8_t length = 0;
+  while (code > 1) {
+    code >>= 1;
+    length++;
+  }
+  return length;
+}
+
+// Length of a packed code in units: one per dot, three per dash and one
+// for each gap between them
+inline uint8_t morseUnits(uint8_t code) {
+  uint8_t units = 0;
+  for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+    units += (code & element) ? 4 : 2;
+  }
+  return units > 0 ? units - 1 : 0;
+}
+
+#endif
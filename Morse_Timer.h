@@ -0,0 +1,71 @@
+/*
+   1 ms keying tick from Timer1.
+
+   Timer1 runs in fast PWM mode 14 with TOP = ICR1 = 1999 and a /8
+   prescaler, so at 16 MHz it overflows exactly every millisecond. The
+   overflow interrupt calls keyTimerTick(), which the sketch defines.
+   Because pins 9 and 10 are Timer1's PWM outputs, analogWrite() no longer
+   scales correctly on them; use timerPwmWrite() for those two pins.
+
+   On the host, keyTimerBegin() registers keyTimerTick() with the virtual
+   clock instead.
+*/
+
+#ifndef MORSE_TIMER_H
+#define MORSE_TIMER_H
+
+#include "Morse_HAL.h"
+
+const unsigned long keyTickUs = 1000;
+
+// Defined by the sketch; runs in interrupt context once per tick
+void keyTimerTick();
+
+#ifdef ARDUINO
+
+const uint16_t timer1Top = 1999;
+
+ISR(TIMER1_OVF_vect) {
+  keyTimerTick();
+}
+
+inline void keyTimerBegin() {
+  noInterrupts();
+  TCCR1A = _BV(COM1A1) | _BV(COM1B1) | _BV(WGM11);  // PWM on pins 9 and 10
+  TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS11);  // Fast PWM to ICR1, clk/8
+  ICR1 = timer1Top;
+  OCR1A = 0;
+  OCR1B = 0;
+  TCNT1 = 0;
+  TIMSK1 = _BV(TOIE1);
+  interrupts();
+}
+
+// Set the duty cycle of pin 9 or 10 on the same 0-255 scale as analogWrite()
+inline void timerPwmWrite(uint8_t pin, uint8_t level) {
+  uint16_t duty = (uint32_t)level * timer1Top / 255;
+  uint8_t sreg = SREG;
+  cli();  // 16-bit registers share a temporary byte with the ISR
+  if (pin == 9) {
+    OCR1A = duty;
+  } else if (pin == 10) {
+    OCR1B = duty;
+  } else {
+    analogWrite(pin, level);
+  }
+  SREG = sreg;
+}
+
+#else
+
+inline void keyTimerBegin() {
+  sim::attachTimer(keyTickUs, keyTimerTick);
+}
+
+inline void timerPwmWrite(uint8_t pin, uint8_t level) {
+  analogWrite(pin, level);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+/*
+   Element timings derived from a words-per-minute setting.
+
+   Speeds use the PARIS standard: a dot is one unit of 1200 / wpm ms, a
+   dash three units, and the gaps inside a character, between characters
+   and between words are one, three and seven units. With Farnsworth
+   spacing the characters are still sent at charWpm, but the gaps between
+   characters and words are stretched so that the overall rate comes out
+   at effectiveWpm (the ARRL formula).
+*/
+
+#ifndef MORSE_TIMING_H
+#define MORSE_TIMING_H
+
+#include "Morse_HAL.h"
+
+const uint8_t minWpm = 5;
+const uint8_t maxWpm = 60;
+
+struct MorseTiming {
+  uint8_t charWpm;
+  uint8_t effectiveWpm;  // Equal to charWpm when Farnsworth spacing is off
+  uint16_t dot;
+  uint16_t dash;
+  uint16_t elementGap;  // After every dot and dash
+  uint16_t letterGap;   // Total silence between two characters
+  uint16_t wordGap;     // Total silence between two words
+};
+
+// effectiveWpm of 0, or not below charWpm, means no Farnsworth spacing
+inline MorseTiming morseTiming(uint8_t charWpm, uint8_t effectiveWpm = 0) {
+  if (charWpm < minWpm) {
+    charWpm = minWpm;
+  } else if (charWpm > maxWpm) {
+    charWpm = maxWpm;
+  }
+  if (effectiveWpm == 0 || effectiveWpm > charWpm) {
+    effectiveWpm = charWpm;
+  } else if (effectiveWpm < minWpm) {
+    effectiveWpm = minWpm;
+  }
+
+  MorseTiming t;
+  uint16_t unit = 1200 / charWpm;
+  t.charWpm = charWpm;
+  t.effectiveWpm = effectiveWpm;
+  t.dot = unit;
+  t.dash = 3 * unit;
+  t.elementGap = unit;
+
+  if (effectiveWpm == charWpm) {
+    t.letterGap = 3 * unit;
+    t.wordGap = 7 * unit;
+  } else {
+    // Extra delay per PARIS word, spread over its 19 units of spacing
+    unsigned long totalDelay = (60000UL * charWpm - 37200UL * effectiveWpm) / ((unsigned long)charWpm * effectiveWpm);
+    t.letterGap = 3 * totalDelay / 19;
+    t.wordGap = 7 * totalDelay / 19;
+  }
+  return t;
+}
+
+#endif
@@ -0,0 +1,215 @@
+/*
+   Optional tracing of the sketch's hot paths.
+
+   Build with MORSE_TRACE defined as 1 (before the first include, or with
+   -DMORSE_TRACE=1) to get a ring of the last 32 timestamped events and a
+   latency histogram for each stage, which the #trace command prints over
+   Serial as CSV. Otherwise every MORSE_TRACE_... macro expands to nothing
+   and no RAM or code is used.
+
+   Histogram bins are powers of two of microseconds: bin 0 counts times
+   under 16us, bin k times under 16us << k, and the last bin everything
+   from 262ms up. Counts stop at 65535 rather than wrapping.
+
+   Events can be recorded from interrupts (the keyer's key on and off) so
+   each update runs with interrupts disabled; it takes a few microseconds.
+   Like Morse_Timer.h this defines objects, so include it from the sketch's
+   one translation unit only.
+*/
+
+#ifndef MORSE_TRACE_H
+#define MORSE_TRACE_H
+
+#include "Morse_HAL.h"
+#include "Morse_Config.h"
+
+enum TraceEvent : uint8_t {
+  TRACE_RX,         // Byte taken from Serial, arg = the byte
+  TRACE_LOOKUP,     // Character looked up and queued for keying, arg = the character
+  TRACE_KEY_ON,
+  TRACE_KEY_OFF,
+  TRACE_LCD_FLUSH,  // Changed cells sent to the LCD
+  TRACE_ERROR       // Character with no code, arg = the character
+};
+
+enum TraceStage : uint8_t {
+  STAGE_LOOP,   // One pass of loop()
+  STAGE_SEND,   // Looking up a character and queueing its elements
+  STAGE_KEY,    // From queueing a character to its first key down
+  STAGE_LCD,    // One incremental LCD flush
+  STAGE_ERROR,  // reportInvalid()
+  traceStages
+};
+
+#if MORSE_TRACE
+
+class Tracer {
+public:
+  static const uint8_t ringSize = 32;  // Power of two
+  static const uint8_t bins = 16;
+
+  Tracer() { clear(); }
+
+  void clear() {
+    uint8_t state = lock();
+    head = 0;
+    used = 0;
+    pending = 0;
+    memset(histogram, 0, sizeof(histogram));
+    unlock(state);
+  }
+
+  void event(TraceEvent kind, uint8_t arg) {
+    uint8_t state = lock();
+    Entry& e = ring[head];
+    e.us = micros();
+    e.kind = kind;
+    e.arg = arg;
+    head = (head + 1) & (ringSize - 1);
+    if (used < ringSize) {
+      used++;
+    }
+    unlock(state);
+  }
+
+  void start(TraceStage stage) {
+    uint8_t state = lock();
+    started[stage] = micros();
+    pending |= 1 << stage;
+    unlock(state);
+  }
+
+  // Adds the time since start(stage) to its histogram; ignored if the
+  // stage was not started, so an end without a start is harmless
+  void end(TraceStage stage) {
+    uint8_t state = lock();
+    if (pending & (1 << stage)) {
+      pending &= ~(1 << stage);
+      uint32_t us = micros() - started[stage];
+      uint8_t bin = 0;
+      for (us >>= 4; us != 0 && bin < bins - 1; us >>= 1) {
+        bin++;
+      }
+      if (histogram[stage][bin] != 0xFFFF) {
+        histogram[stage][bin]++;
+      }
+    }
+    unlock(state);
+  }
+
+  // Print the ring, oldest first, then one row per histogram:
+  //   event,<us>,<name>,<arg>
+  //   hist,<stage>,<count for each bin>
+  void dump(Print& out) {
+    out.println("event,us,name,arg");
+    for (uint8_t i = 0; i < used; i++) {
+      uint8_t state = lock();
+      Entry e = ring[(head - used + i) & (ringSize - 1)];
+      unlock(state);
+      out.print("event,");
+      out.print(e.us);
+      out.print(',');
+      out.print(eventName(e.kind));
+      out.print(',');
+      out.println((unsigned int)e.arg);
+    }
+    out.print("hist,upper_us");
+    for (uint8_t bin = 0; bin < bins - 1; bin++) {
+      out.print(',');
+      out.print(16UL << bin);
+    }
+    out.println(",inf");
+    for (uint8_t stage = 0; stage < traceStages; stage++) {
+      out.print("hist,");
+      out.print(stageName(stage));
+      for (uint8_t bin = 0; bin < bins; bin++) {
+        uint8_t state = lock();
+        uint16_t count = histogram[stage][bin];
+        unlock(state);
+        out.print(',');
+        out.print((unsigned int)count);
+      }
+      out.println();
+    }
+  }
+
+private:
+  struct Entry {
+    uint32_t us;
+    uint8_t kind;
+    uint8_t arg;
+  };
+
+  static const char* eventName(uint8_t kind) {
+    switch (kind) {
+      case TRACE_RX: return "rx";
+      case TRACE_LOOKUP: return "lookup";
+      case TRACE_KEY_ON: return "keyon";
+      case TRACE_KEY_OFF: return "keyoff";
+      case TRACE_LCD_FLUSH: return "lcd";
+      case TRACE_ERROR: return "error";
+    }
+    return "?";
+  }
+
+  static const char* stageName(uint8_t stage) {
+    switch (stage) {
+      case STAGE_LOOP: return "loop";
+      case STAGE_SEND: return "send";
+      case STAGE_KEY: return "key";
+      case STAGE_LCD: return "lcd";
+      case STAGE_ERROR: return "error";
+    }
+    return "?";
+  }
+
+#ifdef ARDUINO
+  static uint8_t lock() {
+    uint8_t state = SREG;
+    cli();
+    return state;
+  }
+  static void unlock(uint8_t state) { SREG = state; }
+#else
+  // The host HAL runs timer interrupts only while virtual time passes (in
+  // delays, LCD and Serial writes, EEPROM waits), never inside micros(),
+  // so nothing can run in the middle of an update here
+  static uint8_t lock() { return 0; }
+  static void unlock(uint8_t) {}
+#endif
+
+  Entry ring[ringSize];
+  uint8_t head;  // Next entry to write
+  uint8_t used;
+  uint32_t started[traceStages];
+  uint8_t pending;  // Bit per stage with a start() awaiting its end()
+  uint16_t histogram[traceStages][bins];
+};
+
+Tracer tracer;
+
+// Times the rest of the enclosing block as stage
+class TraceScope {
+public:
+  explicit TraceScope(TraceStage stage) : stage(stage) { tracer.start(stage); }
+  ~TraceScope() { tracer.end(stage); }
+
+private:
+  TraceStage stage;
+};
+
+#define MORSE_TRACE_EVENT(kind, arg) tracer.event(kind, arg)
+#define MORSE_TRACE_START(stage) tracer.start(stage)
+#define MORSE_TRACE_END(stage) tracer.end(stage)
+#define MORSE_TRACE_SCOPE(stage) TraceScope traceScope(stage)
+
+#else
+
+#define MORSE_TRACE_EVENT(kind, arg) do {} while (0)
+#define MORSE_TRACE_START(stage) do {} while (0)
+#define MORSE_TRACE_END(stage) do {} while (0)
+#define MORSE_TRACE_SCOPE(stage) do {} while (0)
+
+#endif
+
+#endif
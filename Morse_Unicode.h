@@ -0,0 +1,175 @@
+/*
+   UTF-8 input and output for the code pages in Morse_Table.h.
+
+   Utf8Decoder takes Serial input a byte at a time and yields whole code
+   points. morseFromUnicode() then turns a code point into the byte (or,
+   for a voiced kana, the two bytes) that stand for it in an alphabet's
+   page; the sketch queues and displays those bytes. morseToUnicode() and
+   utf8Encode() go the other way, for echoing decoded text.
+
+   Only the Basic Multilingual Plane is handled; anything above it, and
+   any malformed sequence, comes out as U+FFFD.
+*/
+
+#ifndef MORSE_UNICODE_H
+#define MORSE_UNICODE_H
+
+#include "Morse_HAL.h"
+#include "Morse_Table.h"
+
+const uint16_t unicodeReplacement = 0xFFFD;
+
+class Utf8Decoder {
+public:
+  Utf8Decoder() : value(0), remaining(0), beyondBmp(false) {}
+
+  // Feed the next byte. Returns true, with the character in cp, when b
+  // completes one; false while in the middle of a sequence.
+  bool feed(uint8_t b, uint16_t& cp) {
+    if (remaining > 0) {
+      if ((b & 0xC0) == 0x80) {
+        value = (value << 6) | (b & 0x3F);
+        if (--remaining > 0) {
+          return false;
+        }
+        cp = beyondBmp ? unicodeReplacement : value;
+        return true;
+      }
+      remaining = 0;  // Sequence cut short; b starts afresh
+    }
+    if (b < 0x80) {
+      cp = b;
+      return true;
+    }
+    beyondBmp = (b & 0xF8) == 0xF0;
+    if ((b & 0xE0) == 0xC0) {
+      value = b & 0x1F;
+      remaining = 1;
+      return false;
+    }
+    if ((b & 0xF0) == 0xE0) {
+      value = b & 0x0F;
+      remaining = 2;
+      return false;
+    }
+    if (beyondBmp) {
+      remaining = 3;  // Consumed whole, then replaced
+      return false;
+    }
+    cp = unicodeReplacement;  // Stray continuation byte
+    return true;
+  }
+
+private:
+  uint16_t value;
+  uint8_t remaining;  // Continuation bytes still to come
+  bool beyondBmp;
+};
+
+// Full-width katakana U+30A1 to U+30FC as JIS X 0201: the low six bits are
+// the byte less 0xA0 (0 if there is none), the top two bits the voicing
+// mark that follows it, 1 for dakuten and 2 for handakuten
+const uint8_t katakanaToJis[92] PROGMEM = {
+  0x07, 0x11, 0x08, 0x12, 0x09, 0x13, 0x0A, 0x14, 0x0B, 0x15, 0x16, 0x56,
+  0x17, 0x57, 0x18, 0x58, 0x19, 0x59, 0x1A, 0x5A, 0x1B, 0x5B, 0x1C, 0x5C,
+  0x1D, 0x5D, 0x1E, 0x5E, 0x1F, 0x5F, 0x20, 0x60, 0x21, 0x61, 0x0F, 0x22,
+  0x62, 0x23, 0x63, 0x24, 0x64, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x6A,
+  0xAA, 0x2B, 0x6B, 0xAB, 0x2C, 0x6C, 0xAC, 0x2D, 0x6D, 0xAD, 0x2E, 0x6E,
+  0xAE, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x0C, 0x34, 0x0D, 0x35, 0x0E, 0x36,
+  0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3C, 0x00, 0x00, 0x06, 0x3D, 0x53,
+  0x16, 0x19, 0x7C, 0x00, 0x00, 0x46, 0x05, 0x10
+};
+
+// Bytes for cp in alphabet's page, written to out. Returns how many (one,
+// or two for a voiced kana), or 0 if the page has no such character.
+inline uint8_t morseFromUnicode(uint16_t cp, uint8_t alphabet, uint8_t out[2]) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  }
+  uint8_t c = 0;
+  switch (alphabet) {
+    case MORSE_LATIN:
+      c = cp < 0x100 ? cp : 0;
+      break;
+    case MORSE_CYRILLIC:
+      if (cp >= 0x410 && cp <= 0x44F) {
+        c = cp - 0x350;
+      } else if (cp == 0x401) {
+        c = 0xA8;
+      } else if (cp == 0x451) {
+        c = 0xB8;
+      }
+      break;
+    case MORSE_GREEK:
+      if (cp >= 0x384 && cp <= 0x3CE) {
+        c = cp - 0x2D0;
+      }
+      break;
+    case MORSE_WABUN:
+      if (cp >= 0x3041 && cp <= 0x3096) {
+        cp += 0x60;  // Hiragana, sent as the matching katakana
+      }
+      if (cp >= 0x30A1 && cp <= 0x30FC) {
+        uint8_t jis = pgm_read_byte(&katakanaToJis[cp - 0x30A1]);
+        if ((jis & 0x3F) == 0) {
+          return 0;
+        }
+        out[0] = 0xA0 + (jis & 0x3F);
+        if (jis >> 6) {
+          out[1] = (jis >> 6) == 1 ? 0xDE : 0xDF;
+          return 2;
+        }
+        return 1;
+      } else if (cp >= 0xFF61 && cp <= 0xFF9F) {
+        c = cp - 0xFEC0;  // Already half-width
+      } else if (cp == 0x3001) {
+        c = 0xA4;
+      } else if (cp == 0x3002) {
+        c = 0xA1;
+      } else if (cp == 0x300C || cp == 0x300D) {
+        c = cp - 0x300C + 0xA2;
+      }
+      break;
+  }
+  if (c < 0x80) {
+    return 0;
+  }
+  out[0] = c;
+  return 1;
+}
+
+// The code point for byte c of alphabet's page
+inline uint16_t morseToUnicode(uint8_t c, uint8_t alphabet) {
+  if (c < 0x80 || alphabet == MORSE_LATIN) {
+    return c;
+  }
+  switch (alphabet) {
+    case MORSE_CYRILLIC:
+      return c >= 0xC0 ? c + 0x350 : c == 0xA8 ? 0x401 : c == 0xB8 ? 0x451 : unicodeReplacement;
+    case MORSE_GREEK:
+      return c >= 0xB4 ? c + 0x2D0 : unicodeReplacement;
+    case MORSE_WABUN:
+      return c >= 0xA1 && c <= 0xDF ? c + 0xFEC0 : unicodeReplacement;
+  }
+  return unicodeReplacement;
+}
+
+// Write cp as UTF-8 to out and return the number of bytes, 1 to 3
+inline uint8_t utf8Encode(uint16_t cp, char out[3]) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = 0xC0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  }
+  out[0] = 0xE0 | (cp >> 12);
+  out[1] = 0x80 | ((cp >> 6) & 0x3F);
+  out[2] = 0x80 | (cp & 0x3F);
+  return 3;
+}
+
+#endif
@@ -0,0 +1,6 @@
+/*
+   Stands in for the Arduino library header so the sketches that include
+   <LiquidCrystal.h> directly build on the host with -Ihost.
+*/
+
+#include "Morse_HAL_Host.h"
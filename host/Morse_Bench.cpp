@@ -0,0 +1,347 @@
+/*
+   Benchmarks every revision of the sketch on the same input, so the cost
+   of each change shows up as numbers rather than impressions.
+
+   Build (from the repository root):
+     g++ -std=c++17 -O2 -I. -Ihost host/Morse_HAL_Host.cpp host/Morse_Bench.cpp \
+         -o morse_bench
+
+   Usage:
+     ./morse_bench [options] [text...]    text defaults to a pangram line
+
+     --rev NAME        run only this revision (repeatable): rev2, rev3,
+                       rev4-orig (rev4 before the rework, String and all,
+                       as kept in Morse_Convertor_rev4_Heavy_Comments.c)
+                       or rev4 (the current sketch)
+     --csv             print one CSV row per revision instead of a table
+     --stdin           read the text from stdin
+     --loop-us N       virtual time one pass of loop() takes (default 20)
+     --lookups N       character lookups to time per revision (default 10M)
+
+   Each revision's setup() and loop() run on the simulator's virtual clock
+   with the text arriving on Serial at the baud rate it passes to
+   Serial.begin() (9600, or 115200 for rev4), and the recorded events
+   give:
+
+     chars/s      characters keyed per simulated second, from the first
+                  byte received to the end of the last mark
+     latency      per character, from its last bit arriving on RX to the
+                  first key down edge of its code, in ms. The first
+                  character shows the cost of the path from Serial to
+                  the key; the mean, 95th percentile and max include the
+                  wait behind the characters keyed before it
+     dropped      bytes lost to RX buffer overflow
+     heap         String heap high-water mark in bytes, as the AVR core
+                  would allocate it
+     lookup       host ns to map one character to its code and count its
+                  elements, the way that revision does it
+
+   The sketches are compiled into this file, each in its own namespace, so
+   one binary compares them all from one source tree.
+*/
+
+#include "../Morse_HAL.h"
+#include "../Morse_Table.h"
+#include "../Morse_RingBuffer.h"
+#include "../Morse_Keyer.h"
+#include "../Morse_Timing.h"
+#include "../Morse_Decoder.h"
+#include "../Morse_KeyInput.h"
+#include "../Morse_LcdFrame.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// The baseline sketches store their Morse strings as char* and compare an
+// int index with strlen(); they stay as they were written
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+
+namespace rev2 {
+void blinkMorse(char* code);  // Prototypes the Arduino IDE would generate
+#include "../Morse_Convertor_rev2.ino"
+}
+
+namespace rev3 {
+#include "../Morse_Code_Convertor_rev3.c"
+}
+
+namespace rev4orig {
+void blinkMorse(char* code);
+#include "../Morse_Convertor_rev4_Heavy_Comments.c"
+}
+
+#pragma GCC diagnostic pop
+
+namespace rev4 {
+#include "../Morse_Convertor_rev4.c"
+}
+
+// The interrupt handlers the shared headers call are rev4's
+void keyTimerTick() {
+  rev4::keyTimerTick();
+}
+
+void keyInputChange() {
+  rev4::keyInputChange();
+}
+
+static const uint8_t keyPin = 9;  // The Morse LED, in every revision
+
+// Each function below maps c to its code the way that revision's loop()
+// does and returns the number of elements keyed, or 0 if c is not keyed
+
+static int rev2Elements(char c) {
+  char* code = NULL;
+  if (c >= 'a' && c <= 'z') {
+    code = rev2::morseCode[c - 'a'];
+  } else if (c >= 'A' && c <= 'Z') {
+    code = rev2::morseCode[c - 'A'];
+  } else if (c >= '0' && c <= '9') {
+    code = rev2::morseCode[c - '0' + 26];
+  }
+  return code != NULL ? strlen(code) : 0;
+}
+
+// rev3 and the original rev4 share this code and table
+static int switchElements(char c, char** table) {
+  char* code = NULL;
+  if (c >= 'a' && c <= 'z') {
+    code = table[c - 'a'];
+  } else if (c >= 'A' && c <= 'Z') {
+    code = table[c - 'A'];
+  } else if (c >= '0' && c <= '9') {
+    code = table[c - '0' + 26];
+  } else {
+    switch (c) {
+      case ',': code = table[36]; break;
+      case '.': code = table[37]; break;
+      case ';': code = table[38]; break;
+      case ':': code = table[39]; break;
+      case '\'': code = table[40]; break;
+      case '\"': code = table[41]; break;
+      case '-': code = table[42]; break;
+    }
+  }
+  return code != NULL ? strlen(code) : 0;
+}
+
+static int rev3Elements(char c) {
+  return switchElements(c, rev3::morseCode);
+}
+
+static int rev4origElements(char c) {
+  return switchElements(c, rev4orig::morseCode);
+}
+
+static int rev4Elements(char c) {
+  return morseLength(morseEncode(c));
+}
+
+struct Revision {
+  const char* name;
+  void (*setup)();
+  void (*loop)();
+  int (*elements)(char c);
+};
+
+static const Revision revisions[] = {
+  { "rev2", rev2::setup, rev2::loop, rev2Elements },
+  { "rev3", rev3::setup, rev3::loop, rev3Elements },
+  { "rev4-orig", rev4orig::setup, rev4orig::loop, rev4origElements },
+  { "rev4", rev4::setup, rev4::loop, rev4Elements },
+};
+
+struct Result {
+  size_t keyed = 0;
+  double charsPerSecond = 0;
+  double latencyFirstMs = 0;
+  double latencyMeanMs = 0;
+  double latencyP95Ms = 0;
+  double latencyMaxMs = 0;
+  uint32_t dropped = 0;
+  uint32_t heapBytes = 0;
+  double lookupNs = 0;
+  double virtualSeconds = 0;
+  double wallMs = 0;
+};
+
+static void simulate(const Revision& rev, const std::string& text, uint32_t loopUs, Result& result) {
+  const uint64_t idleUs = 3000000;
+  const uint64_t maxUs = 3600000000ULL;
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  sim::reset();
+  uint32_t heapBase = sim::heapInUse();
+  rev.setup();
+  sim::serialFeed(text.data(), text.size(), sim::now());
+
+  uint64_t lastActivity = sim::now();
+  size_t seen = sim::events.size();
+  while (sim::now() < maxUs) {
+    rev.loop();
+    sim::advance(loopUs);
+    for (; seen < sim::events.size(); seen++) {
+      if (sim::events[seen].kind != sim::EV_SERIAL_RX) {
+        lastActivity = sim::events[seen].us;
+      }
+    }
+    if (sim::serialPending() == 0 && sim::now() - lastActivity > idleUs) {
+      break;
+    }
+  }
+  result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+  result.virtualSeconds = lastActivity / 1e6;
+  result.dropped = sim::serialDropped();
+  result.heapBytes = sim::heapHighWater() - heapBase;
+
+  // Pair each received character that gets keyed with the first of its
+  // key down edges; characters are keyed in the order they arrive
+  struct Received {
+    uint64_t us;
+    int elements;
+  };
+  std::vector<Received> received;
+  std::vector<uint64_t> downs;
+  uint64_t firstRx = 0;
+  bool anyRx = false;
+  uint64_t lastUp = 0;
+  bool keyDown = false;
+  for (size_t i = 0; i < sim::events.size(); i++) {
+    const sim::Event& e = sim::events[i];
+    if (e.kind == sim::EV_SERIAL_RX) {
+      if (!anyRx) {
+        firstRx = e.us;
+        anyRx = true;
+      }
+      int n = rev.elements((char)e.value);
+      if (n > 0) {
+        received.push_back(Received{ e.us, n });
+      }
+    } else if ((e.kind == sim::EV_ANALOG_WRITE || e.kind == sim::EV_DIGITAL_WRITE) && e.pin == keyPin) {
+      bool down = e.value != 0;
+      if (down && !keyDown) {
+        downs.push_back(e.us);
+      } else if (!down && keyDown) {
+        lastUp = e.us;
+      }
+      keyDown = down;
+    }
+  }
+
+  std::vector<double> latencies;
+  size_t edge = 0;
+  for (size_t i = 0; i < received.size() && edge < downs.size(); i++) {
+    latencies.push_back((downs[edge] - received[i].us) / 1000.0);
+    edge += received[i].elements;
+  }
+  result.keyed = latencies.size();
+  if (!latencies.empty()) {
+    result.latencyFirstMs = latencies[0];
+    double sum = 0;
+    for (double l : latencies) {
+      sum += l;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    result.latencyMeanMs = sum / latencies.size();
+    result.latencyP95Ms = latencies[(latencies.size() - 1) * 95 / 100];
+    result.latencyMaxMs = latencies.back();
+  }
+  if (lastUp > firstRx) {
+    result.charsPerSecond = result.keyed / ((lastUp - firstRx) / 1e6);
+  }
+}
+
+static double timeLookups(const Revision& rev, const std::string& text, uint64_t lookups) {
+  // Cycle through the text so the branches see realistic input
+  std::string sample;
+  while (sample.size() < 4096) {
+    sample += text;
+  }
+  sample.resize(4096);
+
+  volatile int sink = 0;
+  uint64_t done = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (done < lookups) {
+    int total = 0;
+    for (char c : sample) {
+      total += rev.elements(c);
+    }
+    sink = sink + total;
+    done += sample.size();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return ns / done;
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> selected;
+  bool csv = false;
+  bool readStdin = false;
+  uint32_t loopUs = 20;
+  uint64_t lookups = 10000000;
+  std::string text;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--rev" && i + 1 < argc) {
+      selected.push_back(argv[++i]);
+    } else if (arg == "--csv") {
+      csv = true;
+    } else if (arg == "--stdin") {
+      readStdin = true;
+    } else if (arg == "--loop-us" && i + 1 < argc) {
+      loopUs = (uint32_t)atol(argv[++i]);
+    } else if (arg == "--lookups" && i + 1 < argc) {
+      lookups = atoll(argv[++i]);
+    } else {
+      if (!text.empty()) {
+        text += ' ';
+      }
+      text += arg;
+    }
+  }
+  if (readStdin) {
+    text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+  } else {
+    if (text.empty()) {
+      text = "The quick brown fox jumps over the lazy dog 1234567890";
+    }
+    text += '\n';
+  }
+
+  if (csv) {
+    printf("revision,chars,chars_per_s,latency_first_ms,latency_mean_ms,latency_p95_ms,latency_max_ms,"
+           "rx_dropped,heap_bytes,lookup_ns,virtual_s,wall_ms\n");
+  } else {
+    printf("%-10s %6s %9s %9s %10s %10s %10s %8s %6s %10s\n", "revision", "chars", "chars/s",
+           "first ms", "mean ms", "p95 ms", "max ms", "dropped", "heap", "lookup ns");
+  }
+
+  for (const Revision& rev : revisions) {
+    if (!selected.empty() && std::find(selected.begin(), selected.end(), rev.name) == selected.end()) {
+      continue;
+    }
+    Result r;
+    simulate(rev, text, loopUs, r);
+    r.lookupNs = timeLookups(rev, text, lookups);
+
+    if (csv) {
+      printf("%s,%zu,%.4f,%.3f,%.3f,%.3f,%.3f,%u,%u,%.3f,%.3f,%.1f\n", rev.name, r.keyed, r.charsPerSecond,
+             r.latencyFirstMs, r.latencyMeanMs, r.latencyP95Ms, r.latencyMaxMs, r.dropped, r.heapBytes, r.lookupNs,
+             r.virtualSeconds, r.wallMs);
+    } else {
+      printf("%-10s %6zu %9.3f %9.1f %10.1f %10.1f %10.1f %8u %6u %10.2f\n", rev.name, r.keyed, r.charsPerSecond,
+             r.latencyFirstMs, r.latencyMeanMs, r.latencyP95Ms, r.latencyMaxMs, r.dropped, r.heapBytes, r.lookupNs);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
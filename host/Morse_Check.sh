@@ -0,0 +1,116 @@
+#!/bin/sh
+#
+# Regression checks: runs the sketch under morse_sim and the host tools on
+# fixed inputs and compares what they did with what they should have done,
+# then runs the render-to-listen sweep in Morse_Roundtrip.sh.
+#
+# Usage (from the repository root):
+#   host/Morse_Check.sh
+#
+# Needs a C++17 compiler as c++ (or set CXX). Prints one line per check
+# and exits non-zero if any fails. Add a check by calling check with a
+# name, the expected output and the actual output.
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cxx=${CXX:-c++}
+
+# morse_sim for the sketch built with the given Morse_Config.h switches
+build_sim() {
+  out=$1
+  shift
+  "$cxx" -std=c++17 -O2 -I"$root" "$@" -x c++ "$root/Morse_Convertor_rev4.c" -x none \
+    "$root/host/Morse_HAL_Host.cpp" "$root/host/Morse_Sim.cpp" -o "$work/$out"
+}
+
+build_sim morse_sim
+build_sim morse_sim2 -DMORSE_CHANNELS=2
+"$cxx" -std=c++17 -O2 -pthread -I"$root" "$root/host/Morse_Encoder.cpp" \
+  "$root/host/Morse_Encode.cpp" -o "$work/morse_encode"
+"$cxx" -std=c++17 -O2 -I"$root" "$root/host/Morse_Encoder.cpp" "$root/host/Morse_Wav.cpp" \
+  "$root/host/Morse_Render.cpp" -o "$work/morse_render"
+
+# A tool that fails outright shows up as a failed check, not the end of the run
+set +e
+
+failed=0
+check() {
+  if [ "$2" = "$3" ]; then
+    echo "ok   $1"
+  else
+    failed=$((failed + 1))
+    echo "FAIL $1"
+    echo "       expected: $2"
+    echo "       got:      $3"
+  fi
+}
+
+# The LCD's second row once the run is over
+lcd_row1() {
+  sed -n 's/^lcd row 1: *//p'
+}
+
+blank='[                ]'
+
+# The sketch: back to the prompt once a line has been keyed
+out=$(printf 'HI\n' | "$work/morse_sim" 2>&1 >/dev/null | lcd_row1)
+check "prompt comes back after a line" "$blank" "$out"
+
+out=$(printf 'E\n#ch 1\n#ch 0\n' | "$work/morse_sim2" 2>&1 >/dev/null | lcd_row1)
+check "two channels: prompt comes back after switching away" "$blank" "$out"
+
+out=$(printf 'E\n#ch 1\nEE\n' | "$work/morse_sim2" 2>&1 >/dev/null | lcd_row1)
+check "two channels: a newline on channel 1 keeps channel 0's prompt restore" "$blank" "$out"
+
+# Save a slot on channel 1, then play it there while channel 0 holds its line
+printf '#ch 1\n#save S\nEE\n' | "$work/morse_sim2" --eeprom "$work/eeprom" >/dev/null 2>&1
+out=$(printf 'E\n#ch 1\n#play S\n' | "$work/morse_sim2" --eeprom "$work/eeprom" 2>&1 >/dev/null | lcd_row1)
+check "two channels: a slot ending on channel 1 keeps channel 0's prompt restore" "$blank" "$out"
+
+# Speed commands take whole numbers in range and nothing else
+speed() {
+  printf '#wpm 20\n%s\n' "$1" | "$work/morse_sim" --serial 2>/dev/null | tr -d '\r' | tail -n 1
+}
+check "#wpm in range" 'Speed 25 WPM' "$(speed '#wpm 25')"
+check "#wpm above 60 is refused, not wrapped" 'Speed 20 WPM' "$(speed '#wpm 300')"
+check "#wpm that is not a number is refused" 'Speed 20 WPM' "$(speed '#wpm abc')"
+check "#fwpm below the character speed" 'Speed 20 WPM, Farnsworth 10 WPM' "$(speed '#fwpm 10')"
+check "#fwpm above the character speed is refused" 'Speed 20 WPM' "$(speed '#fwpm 30')"
+
+# Host encoding of UTF-8 input
+out=$(printf 'HI YOU\n' | "$work/morse_encode" -q)
+check "encode ASCII" '.... .. / -.-- --- ..- ' "$out"
+
+out=$(printf '\303\211T\n' | "$work/morse_encode" -q)
+check "encode UTF-8 Latin-1 letter" '..-.. - ' "$out"
+
+out=$(printf 'A\304\207B\n' | "$work/morse_encode" 2>&1 >/dev/null | sed 's/.*, //')
+check "encode UTF-8 letter with no Latin code is dropped and counted" '1 characters without a code' "$out"
+
+out=$(printf '\320\277\321\200\320\270\320\262\320\265\321\202\n' | "$work/morse_encode" -q -a cyrillic)
+check "encode UTF-8 Cyrillic" '.--. .-. .. .-- . - ' "$out"
+
+out=$( (printf '\320'; sleep 0.2; printf '\277\n') | "$work/morse_encode" -q -a cyrillic)
+check "encode UTF-8 split across reads" '.--. ' "$out"
+
+# GO is KO and the dakuten
+out=$(printf '\343\202\264\n' | "$work/morse_encode" -q -a wabun)
+check "encode voiced kana as two symbols" '---- .. ' "$out"
+
+printf 'PRIWET\n' | "$work/morse_render" -q -o "$work/latin.wav"
+printf '\320\277\321\200\320\270\320\262\320\265\321\202\n' | "$work/morse_render" -q -a cyrillic -o "$work/cyrillic.wav"
+out=$(cmp -s "$work/latin.wav" "$work/cyrillic.wav" && echo same || echo different)
+check "render UTF-8 Cyrillic as the Latin letters with the same codes" same "$out"
+
+if ! "$root/host/Morse_Roundtrip.sh"; then
+  failed=$((failed + 1))
+fi
+
+if [ "$failed" -ne 0 ]; then
+  echo "$failed check(s) failed"
+  exit 1
+fi
+echo "all checks passed"
@@ -0,0 +1,276 @@
+/*
+   Drives the sketch over its serial port with the framed protocol of
+   Morse_Protocol.h, for scripts and for controlling several boards at once.
+
+   Build (from the repository root):
+     g++ -std=c++17 -O2 -I. host/Morse_Control.cpp -o morse_control
+
+   Usage:
+     ./morse_control [options] DEVICE [input]
+
+     -c N           apply everything below to channel N (default 0)
+     -w WPM[/FWPM]  set the speed, 5-60, with an optional Farnsworth speed
+                    from 5 up to WPM (0 for none)
+     -p HZ          set the tone pitch
+     -v LEVEL       set the sidetone volume, 0-255 (all channels)
+     -b LEVEL       set the LED brightness, 0-255
+     -a             abort whatever is being sent
+     -s             print the status once everything else is done
+     input          file of UTF-8 text to send, or - for stdin
+
+   The channel is selected first, then the settings, the text and the
+   status query follow. Each frame waits for its answer and is sent again
+   after a timeout; a full queue is retried until the keyer has made room,
+   so any amount of text can be uploaded. Opening the port resets an
+   Uno, so the board is given two seconds to start before the first
+   frame.
+*/
+
+#include "../Morse_Protocol.h"
+#include "../Morse_Timing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int replyTimeoutMs = 500;
+static const int attempts = 5;
+
+static unsigned long nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct FrameBuffer {
+  std::vector<uint8_t> bytes;
+  void write(uint8_t b) { bytes.push_back(b); }
+};
+
+class Port {
+public:
+  explicit Port(const char* path) : fd(open(path, O_RDWR | O_NOCTTY)), seq((uint8_t)nowMs()), paused(false) {
+    if (fd < 0) {
+      fprintf(stderr, "morse_control: %s: %s\n", path, strerror(errno));
+      exit(1);
+    }
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tcsetattr(fd, TCSANOW, &tio);
+    std::this_thread::sleep_for(std::chrono::seconds(2));  // Bootloader, then setup()
+    tcflush(fd, TCIFLUSH);
+  }
+
+  // Send a request until it is answered. Returns the answer, with
+  // reader.type FRAME_NAK for a refusal other than a full queue.
+  const FrameReader& request(uint8_t type, const uint8_t* payload, uint8_t length) {
+    seq++;
+    for (int attempt = 0; attempt < attempts; ) {
+      waitWhilePaused();
+      FrameBuffer frame;
+      frameSend(frame, type, seq, payload, length);
+      if (::write(fd, frame.bytes.data(), frame.bytes.size()) < 0) {
+        fprintf(stderr, "morse_control: write: %s\n", strerror(errno));
+        exit(1);
+      }
+      if (!readReply(replyTimeoutMs)) {
+        attempt++;
+        continue;
+      }
+      if (reader.type == FRAME_NAK && reader.length == 1 && reader.payload[0] == FRAME_QUEUE_FULL) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        continue;  // Not a failure; the keyer will make room
+      }
+      if (reader.type == FRAME_NAK && reader.length == 1 && reader.payload[0] == FRAME_BAD_CRC) {
+        attempt++;
+        continue;
+      }
+      return reader;
+    }
+    fprintf(stderr, "morse_control: no answer from the board\n");
+    exit(1);
+  }
+
+private:
+  // Read until the answer to seq arrives or timeoutMs passes. Anything
+  // else on the line (the sketch's prompts, XON/XOFF) is dealt with here.
+  bool readReply(int timeoutMs) {
+    unsigned long start = nowMs();
+    while (nowMs() - start < (unsigned long)timeoutMs) {
+      uint8_t b;
+      if (!readByte(b, 10)) {
+        continue;
+      }
+      if (b == 0x11 || b == 0x13) {
+        paused = b == 0x13;
+      } else if (reader.feed(b, nowMs()) == FrameReader::READ_FRAME && reader.seq == seq) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void waitWhilePaused() {
+    while (paused) {
+      uint8_t b;
+      if (readByte(b, 100) && (b == 0x11 || b == 0x13)) {
+        paused = b == 0x13;
+      }
+    }
+  }
+
+  bool readByte(uint8_t& b, int timeoutMs) {
+    pollfd p = { fd, POLLIN, 0 };
+    return poll(&p, 1, timeoutMs) > 0 && read(fd, &b, 1) == 1;
+  }
+
+  int fd;
+  uint8_t seq;  // Starts anywhere, so a resent frame is never taken for one from an earlier run
+  bool paused;  // XOFF seen and not yet followed by XON
+  FrameReader reader;
+};
+
+static void usage() {
+  fprintf(stderr, "usage: morse_control [-c channel] [-w wpm[/fwpm]] [-p hz] [-v volume] [-b level] [-a] [-s] device [input]\n");
+  exit(2);
+}
+
+// text as a whole number from low to high; anything else is a usage error
+static int number(const char* text, long low, long high) {
+  char* end;
+  errno = 0;
+  long n = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || errno != 0 || n < low || n > high) {
+    usage();
+  }
+  return (int)n;
+}
+
+static void check(const FrameReader& reply, const char* what) {
+  if (reply.type == FRAME_NAK) {
+    fprintf(stderr, "morse_control: %s refused (error %u)\n", what, reply.length > 0 ? reply.payload[0] : 0);
+    exit(1);
+  }
+}
+
+static unsigned long field(const uint8_t* p, int bytes) {
+  unsigned long value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+int main(int argc, char** argv) {
+  int channel = -1, wpm = 0, fwpm = 0, pitch = 0, level = -1, volume = -1;
+  bool abortFirst = false, status = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:w:p:v:b:as")) != -1) {
+    switch (opt) {
+      case 'w': {
+        // Range checked here as the casts to a byte below would wrap
+        std::string speeds = optarg;
+        size_t slash = speeds.find('/');
+        wpm = number(speeds.substr(0, slash).c_str(), minWpm, maxWpm);
+        if (slash != std::string::npos) {
+          fwpm = number(speeds.substr(slash + 1).c_str(), 0, wpm);
+          if (fwpm != 0 && fwpm < minWpm) {
+            usage();
+          }
+        }
+        break;
+      }
+      // The board refuses a channel or pitch it cannot use; these only
+      // keep the values whole on the way there
+      case 'c': channel = number(optarg, 0, 255); break;
+      case 'p': pitch = number(optarg, 1, 0xFFFF); break;
+      case 'v': volume = number(optarg, 0, 255); break;
+      case 'b': level = number(optarg, 0, 255); break;
+      case 'a': abortFirst = true; break;
+      case 's': status = true; break;
+      default: usage();
+    }
+  }
+  if (optind >= argc || argc - optind > 2) {
+    usage();
+  }
+
+  std::string text;
+  if (optind + 1 < argc) {
+    const char* input = argv[optind + 1];
+    if (strcmp(input, "-") == 0) {
+      text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    } else {
+      FILE* in = fopen(input, "rb");
+      if (in == NULL) {
+        fprintf(stderr, "morse_control: %s: %s\n", input, strerror(errno));
+        return 1;
+      }
+      char buffer[4096];
+      size_t n;
+      while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        text.append(buffer, n);
+      }
+      fclose(in);
+    }
+  }
+
+  Port port(argv[optind]);
+  if (channel >= 0) {
+    uint8_t payload = (uint8_t)channel;
+    check(port.request(FRAME_SET_CHANNEL, &payload, 1), "channel");
+  }
+  if (abortFirst) {
+    check(port.request(FRAME_ABORT, NULL, 0), "abort");
+  }
+  if (wpm != 0) {
+    uint8_t payload[2] = { (uint8_t)wpm, (uint8_t)fwpm };
+    check(port.request(FRAME_SET_WPM, payload, 2), "speed");
+  }
+  if (pitch != 0) {
+    uint8_t payload[2] = { (uint8_t)(pitch >> 8), (uint8_t)pitch };
+    check(port.request(FRAME_SET_PITCH, payload, 2), "pitch");
+  }
+  if (volume >= 0) {
+    uint8_t payload = (uint8_t)volume;
+    check(port.request(FRAME_SET_VOLUME, &payload, 1), "volume");
+  }
+  if (level >= 0) {
+    uint8_t payload = (uint8_t)level;
+    check(port.request(FRAME_SET_BRIGHTNESS, &payload, 1), "brightness");
+  }
+  for (size_t i = 0; i < text.size(); i += framePayloadMax) {
+    size_t n = std::min(text.size() - i, (size_t)framePayloadMax);
+    check(port.request(FRAME_TEXT, (const uint8_t*)text.data() + i, n), "text");
+  }
+  if (status) {
+    const FrameReader& reply = port.request(FRAME_STATUS, NULL, 0);
+    check(reply, "status");
+    const uint8_t* p = reply.payload;
+    printf("channel:    %u of %u\n", p[18], p[19]);
+    printf("queue:      %lu/%lu chars, %u elements\n", field(p, 2), field(p + 2, 2), p[4]);
+    printf("keying:     %s%s%s\n", (p[5] & 1) ? "yes" : "no", (p[5] & 2) ? ", paused by XOFF" : "",
+           (p[5] & 4) ? ", in receive mode" : "");
+    printf("speed:      %u WPM, effective %u WPM\n", p[6], p[7]);
+    printf("pitch:      %lu Hz, volume %u\n", field(p + 8, 2), p[20]);
+    printf("brightness: %u\n", p[10]);
+    printf("alphabet:   %u\n", p[11]);
+    printf("sent:       %lu chars, %lu with no code\n", field(p + 12, 4), field(p + 16, 2));
+    printf("abbrev:     %lu units saved on the last line\n", field(p + 21, 2));
+  }
+  return 0;
+}
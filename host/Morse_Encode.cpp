@@ -0,0 +1,159 @@
+/*
+   Command line bulk encoder: text in, Morse out, throughput on stderr.
+
+   Build (from the repository root):
+     g++ -std=c++17 -O2 -pthread -I. host/Morse_Encoder.cpp \
+         host/Morse_Encode.cpp -o morse_encode
+
+   Usage:
+     ./morse_encode [options] [input]     input defaults to stdin
+
+     -f text|timing    output format (default text, see Morse_Encoder.h)
+     -a ALPHABET       latin, cyrillic, greek or wabun (default latin): the
+                       code page UTF-8 input is keyed in, as with #alpha
+     -j N              encode with N threads (default 1; needs a file input)
+     -o FILE           write to FILE instead of stdout
+     -q                do not print the summary
+
+   A file input is memory mapped and cut into blocks at line boundaries.
+   With -j, each round encodes N blocks in parallel into per-thread buffers
+   that are reused, and writes them out in order, so memory use stays
+   bounded however large the input is.
+*/
+
+#include "Morse_Encoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t blockSize = 8 << 20;  // Input bytes per block
+
+static void usage() {
+  fprintf(stderr, "usage: morse_encode [-f text|timing] [-a alphabet] [-j threads] [-o file] [-q] [input]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  morse::Format format = morse::FORMAT_TEXT;
+  uint8_t alphabet = MORSE_LATIN;
+  unsigned threads = 1;
+  const char* inputPath = nullptr;
+  const char* outputPath = nullptr;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-f" && i + 1 < argc) {
+      std::string name = argv[++i];
+      if (name == "text") {
+        format = morse::FORMAT_TEXT;
+      } else if (name == "timing") {
+        format = morse::FORMAT_TIMING;
+      } else {
+        usage();
+      }
+    } else if (arg == "-a" && i + 1 < argc) {
+      alphabet = morse::alphabetNamed(argv[++i]);
+      if (alphabet == morseAlphabets) {
+        usage();
+      }
+    } else if (arg == "-j" && i + 1 < argc) {
+      threads = (unsigned)atoi(argv[++i]);
+      if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+      }
+    } else if (arg == "-o" && i + 1 < argc) {
+      outputPath = argv[++i];
+    } else if (arg == "-q") {
+      quiet = true;
+    } else if (arg[0] == '-' && arg != "-") {
+      usage();
+    } else {
+      inputPath = arg == "-" ? nullptr : argv[i];
+    }
+  }
+
+  int outFd = 1;
+  if (outputPath != nullptr) {
+    outFd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd < 0) {
+      fprintf(stderr, "morse_encode: %s: %s\n", outputPath, strerror(errno));
+      return 1;
+    }
+  }
+
+  const morse::Encoder encoder(format, alphabet);
+  morse::FdSink out(outFd);
+  size_t inputBytes = 0;
+  size_t invalid = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  if (inputPath != nullptr) {
+    morse::MappedFile file;
+    if (!file.open(inputPath)) {
+      fprintf(stderr, "morse_encode: %s: %s\n", inputPath, strerror(errno));
+      return 1;
+    }
+    std::string_view text = file.contents();
+    inputBytes = text.size();
+
+    if (threads <= 1) {
+      invalid = encoder.encode(text, out);
+    } else {
+      std::vector<std::string_view> blocks = morse::splitLines(text, text.size() / blockSize + 1);
+      std::vector<morse::VectorSink> buffers(threads);
+      std::vector<size_t> counts(threads);
+      for (size_t first = 0; first < blocks.size(); first += threads) {
+        size_t n = blocks.size() - first < threads ? blocks.size() - first : threads;
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < n; t++) {
+          workers.emplace_back([&, t] {
+            buffers[t].clear();
+            counts[t] = encoder.encode(blocks[first + t], buffers[t]);
+          });
+        }
+        for (size_t t = 0; t < n; t++) {
+          workers[t].join();
+          out.write(buffers[t].begin(), buffers[t].size());
+          invalid += counts[t];
+        }
+      }
+    }
+  } else {
+    std::vector<char> buffer(1 << 20);
+    Utf8Decoder utf8;  // A read can end partway through a character
+    for (;;) {
+      ssize_t n = read(0, buffer.data(), buffer.size());
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      inputBytes += n;
+      invalid += encoder.encode(std::string_view(buffer.data(), n), out, utf8);
+    }
+  }
+
+  out.flush();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!out.ok()) {
+    fprintf(stderr, "morse_encode: write failed: %s\n", strerror(errno));
+    return 1;
+  }
+
+  if (!quiet) {
+    fprintf(stderr, "%zu bytes in %.3f s, %.1f MB/s, %u thread%s, %zu characters without a code\n",
+            inputBytes, seconds, seconds > 0 ? inputBytes / seconds / 1e6 : 0.0,
+            threads, threads == 1 ? "" : "s", invalid);
+  }
+  return 0;
+}
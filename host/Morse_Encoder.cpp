@@ -0,0 +1,165 @@
+/*
+   Encoder tables, output sinks and file mapping behind Morse_Encoder.h.
+*/
+
+#include "Morse_Encoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace morse {
+
+Encoder::Encoder(Format format, uint8_t alphabet) : alphabet(alphabet) {
+  for (int c = 0; c < 256; c++) {
+    Piece& piece = pieces[c];
+    memset(piece.bytes, 0, sizeof(piece.bytes));
+    piece.length = 0;
+    piece.invalid = 0;
+
+    std::string out;
+    if (c == '\n') {
+      out = format == FORMAT_TEXT ? "\n" : "-4\n";
+    } else if (c == ' ') {
+      out = format == FORMAT_TEXT ? "/ " : "-4 ";
+    } else if (c == '\r') {
+      // Dropped without complaint, so CRLF files encode like LF files
+    } else {
+      uint8_t code = morseEncode((char)c, alphabet);
+      if (code == morseInvalid) {
+        piece.invalid = 1;
+      }
+      for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+        bool dash = code & element;
+        if (format == FORMAT_TEXT) {
+          out += dash ? '-' : '.';
+        } else {
+          out += dash ? "+3 " : "+1 ";
+          out += element == 1 ? "-3 " : "-1 ";
+        }
+      }
+      if (format == FORMAT_TEXT && !out.empty()) {
+        out += ' ';
+      }
+    }
+    memcpy(piece.bytes, out.data(), out.size());
+    piece.length = (uint8_t)out.size();
+  }
+}
+
+uint8_t alphabetNamed(const char* name) {
+  static const char* const names[morseAlphabets] = { "latin", "cyrillic", "greek", "wabun" };
+  for (uint8_t i = 0; i < morseAlphabets; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return i;
+    }
+  }
+  return morseAlphabets;
+}
+
+FdSink::FdSink(int fd, size_t capacity) : fd(fd), buffer(capacity) {}
+
+FdSink::~FdSink() {
+  flush();
+}
+
+char* FdSink::reserve(size_t n) {
+  if (buffer.size() - used < n) {
+    flush();
+    if (buffer.size() < n) {
+      buffer.resize(n);
+    }
+  }
+  return buffer.data() + used;
+}
+
+void FdSink::write(const char* data, size_t n) {
+  if (n >= buffer.size()) {
+    flush();
+    while (n > 0 && good) {
+      ssize_t done = ::write(fd, data, n);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      good = done > 0;
+      data += done > 0 ? done : 0;
+      n -= done > 0 ? done : 0;
+    }
+    return;
+  }
+  char* out = reserve(n);
+  memcpy(out, data, n);
+  commit(out + n);
+}
+
+void FdSink::flush() {
+  const char* p = buffer.data();
+  while (used > 0 && good) {
+    ssize_t done = ::write(fd, p, used);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    good = done > 0;
+    p += done > 0 ? done : 0;
+    used -= done > 0 ? done : 0;
+  }
+  used = 0;
+}
+
+MappedFile::~MappedFile() {
+  if (data != nullptr) {
+    munmap(data, size);
+  }
+}
+
+bool MappedFile::open(const char* path) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return true;  // mmap() refuses empty files; an empty view is fine
+  }
+  void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    size = 0;
+    return false;
+  }
+  madvise(p, size, MADV_SEQUENTIAL);
+  data = p;
+  return true;
+}
+
+std::vector<std::string_view> splitLines(std::string_view text, size_t parts) {
+  std::vector<std::string_view> pieces;
+  if (parts == 0) {
+    parts = 1;
+  }
+  size_t target = text.size() / parts + 1;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = start + target;
+    if (end >= text.size()) {
+      end = text.size();
+    } else {
+      size_t newline = text.find('\n', end);
+      end = newline == std::string_view::npos ? text.size() : newline + 1;
+    }
+    pieces.push_back(text.substr(start, end - start));
+    start = end;
+  }
+  return pieces;
+}
+
+}  // namespace morse
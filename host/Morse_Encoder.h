@@ -0,0 +1,217 @@
+/*
+   Bulk text to Morse encoder for the host, using the sketch's own tables.
+
+   Input is UTF-8, taken as the sketch takes it from Serial: each
+   character becomes the byte (or two) that stands for it in one of the
+   code pages of Morse_Table.h, and each of those bytes maps to a fixed
+   piece of output. Encoder precomputes the pieces once and encode()
+   copies them straight into a caller's output buffer, with no allocation
+   per character. ASCII is one table lookup a byte; only bytes from 0x80
+   up go through Utf8Decoder and morseFromUnicode(). The one piece of
+   state between calls is the Utf8Decoder the caller passes in, so text
+   can be encoded in any sized pieces, even ones that split a character.
+
+   Two output formats:
+
+     text    dots and dashes, a space after each character and "/ " for a
+             word gap: "HI YOU" -> ".... .. / -.-- --- ..- "
+     timing  key events in PARIS units, "+n" key down and "-n" key up:
+             "E T" -> "+1 -3 -4 +3 -3 ". Consecutive gaps add up, so the
+             "-3 -4" between words is the standard seven unit gap.
+
+   A newline ends a word as a space does and is kept in the output so line
+   structure survives. Carriage returns are dropped, and so are characters
+   with no Morse code in the alphabet (those are counted).
+*/
+
+#ifndef MORSE_ENCODER_H
+#define MORSE_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+#include "../Morse_Table.h"
+#include "../Morse_Unicode.h"
+
+namespace morse {
+
+enum Format {
+  FORMAT_TEXT,
+  FORMAT_TIMING
+};
+
+// One key state of an encoded stream: down (mark) or up (gap) for units
+struct Element {
+  bool on;
+  uint8_t units;
+};
+
+class Encoder {
+public:
+  // Most output any single input byte can produce
+  static const size_t maxOutputPerByte = 48;
+
+  explicit Encoder(Format format, uint8_t alphabet = MORSE_LATIN);
+
+  // Encode input into sink, which must provide
+  //   char* reserve(size_t n)   room for at least n more bytes
+  //   void commit(char* end)    everything up to end is now written
+  // utf8 carries a character split across calls over to the next one.
+  // Returns the number of characters that had no code and were dropped.
+  template <typename Sink>
+  size_t encode(std::string_view input, Sink& sink, Utf8Decoder& utf8) const {
+    const size_t block = 4096;
+    size_t invalid = 0;
+    const uint8_t* p = (const uint8_t*)input.data();
+    const uint8_t* end = p + input.size();
+    Utf8Decoder decoder = utf8;  // A local copy stays in registers
+
+    while (p < end) {
+      size_t n = end - p < (ptrdiff_t)block ? end - p : block;
+      // A multi-byte character takes at least two bytes and gives at most
+      // two pieces; the two spare pieces cover one begun in the last block
+      char* out = sink.reserve((n + 2) * maxOutputPerByte);
+      for (const uint8_t* stop = p + n; p < stop; p++) {
+        if (*p < 0x80) {
+          decoder = Utf8Decoder();  // Ends any sequence cut short, as feed() would
+          const Piece& piece = pieces[*p];
+          memcpy(out, piece.bytes, maxOutputPerByte);  // Fixed size copy, no branch on length
+          out += piece.length;
+          invalid += piece.invalid;
+          continue;
+        }
+        uint16_t cp;
+        if (!decoder.feed(*p, cp)) {
+          continue;
+        }
+        uint8_t bytes[2];
+        uint8_t count = morseFromUnicode(cp, alphabet, bytes);
+        invalid += count == 0;
+        for (uint8_t i = 0; i < count; i++) {
+          const Piece& piece = pieces[bytes[i]];
+          memcpy(out, piece.bytes, maxOutputPerByte);
+          out += piece.length;
+          invalid += piece.invalid;
+        }
+      }
+      sink.commit(out);
+    }
+    utf8 = decoder;
+    return invalid;
+  }
+
+  // Encode input that starts and ends on a character boundary
+  template <typename Sink>
+  size_t encode(std::string_view input, Sink& sink) const {
+    Utf8Decoder utf8;
+    return encode(input, sink, utf8);
+  }
+
+private:
+  struct Piece {
+    char bytes[maxOutputPerByte];
+    uint8_t length;
+    uint8_t invalid;
+  };
+  Piece pieces[256];  // By byte of the alphabet's code page
+  uint8_t alphabet;
+};
+
+// Calls f(Element) for each element of UTF-8 text in alphabet, gaps
+// included, following the same conventions as the timing format. utf8
+// carries a character split across calls over to the next one.
+template <typename F>
+void forEachElement(std::string_view text, uint8_t alphabet, Utf8Decoder& utf8, F&& f) {
+  for (char c : text) {
+    uint16_t cp;
+    if (!utf8.feed((uint8_t)c, cp)) {
+      continue;
+    }
+    if (cp == ' ' || cp == '\n') {
+      f(Element{ false, 4 });  // Stretches the letter gap to a word gap
+      continue;
+    }
+    uint8_t bytes[2];
+    uint8_t count = morseFromUnicode(cp, alphabet, bytes);
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t code = morseEncode((char)bytes[i], alphabet);
+      for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+        f(Element{ true, (uint8_t)((code & element) ? 3 : 1) });
+        f(Element{ false, (uint8_t)(element == 1 ? 3 : 1) });
+      }
+    }
+  }
+}
+
+// The alphabet called name ("latin", "cyrillic", "greek" or "wabun", as
+// for the sketch's #alpha), or morseAlphabets if there is none
+uint8_t alphabetNamed(const char* name);
+
+// Sink that appends to a growable buffer; reuse it to avoid reallocating
+class VectorSink {
+public:
+  char* reserve(size_t n) {
+    if (data.size() - used < n) {
+      data.resize(used + n);
+    }
+    return data.data() + used;
+  }
+  void commit(char* end) { used = end - data.data(); }
+  void clear() { used = 0; }
+
+  const char* begin() const { return data.data(); }
+  size_t size() const { return used; }
+
+private:
+  std::vector<char> data;
+  size_t used = 0;
+};
+
+// Sink with a fixed buffer that is written to a file descriptor when full
+class FdSink {
+public:
+  explicit FdSink(int fd, size_t capacity = 1 << 20);
+  ~FdSink();
+
+  char* reserve(size_t n);
+  void commit(char* end) { used = end - buffer.data(); }
+  void write(const char* data, size_t n);
+  void flush();
+
+  // False once a write to the descriptor has failed
+  bool ok() const { return good; }
+
+private:
+  int fd;
+  std::vector<char> buffer;
+  size_t used = 0;
+  bool good = true;
+};
+
+// Read-only memory map of a whole file
+class MappedFile {
+public:
+  MappedFile() {}
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false (and leaves errno set) if the file cannot be mapped
+  bool open(const char* path);
+  std::string_view contents() const { return std::string_view((const char*)data, size); }
+
+private:
+  void* data = nullptr;
+  size_t size = 0;
+};
+
+// Split text into up to parts pieces that each end at a newline (except
+// possibly the last), so they can be encoded independently
+std::vector<std::string_view> splitLines(std::string_view text, size_t parts);
+
+}  // namespace morse
+
+#endif
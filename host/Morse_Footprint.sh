@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Builds the sketch for the Uno in each configuration of Morse_Config.h
+# below and prints the flash and SRAM it uses.
+#
+# Usage (from the repository root):
+#   host/Morse_Footprint.sh [fqbn]      fqbn defaults to arduino:avr:uno
+#
+# Needs arduino-cli with the arduino:avr core installed. Add a line to
+# configs to measure another combination; each line is a name and the
+# compiler flags for it.
+
+set -e
+
+fqbn=${1:-arduino:avr:uno}
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+configs='full
+rev4      -DMORSE_RECEIVE=0 -DMORSE_PROTOCOL=0 -DMORSE_SLOTS=0 -DMORSE_ABBREV=0
+rev3      -DMORSE_RECEIVE=0 -DMORSE_PROTOCOL=0 -DMORSE_SLOTS=0 -DMORSE_ABBREV=0 -DMORSE_BUZZER=0
+rev2      -DMORSE_RECEIVE=0 -DMORSE_PROTOCOL=0 -DMORSE_SLOTS=0 -DMORSE_ABBREV=0 -DMORSE_BUZZER=0 -DMORSE_LCD=0 -DMORSE_ERROR_LED=0
+minimal   -DMORSE_RECEIVE=0 -DMORSE_PROTOCOL=0 -DMORSE_SLOTS=0 -DMORSE_ABBREV=0 -DMORSE_BUZZER=0 -DMORSE_LCD=0 -DMORSE_ERROR_LED=0 -DMORSE_ECHO=0
+trace     -DMORSE_TRACE=1
+channels3 -DMORSE_CHANNELS=3'
+
+# arduino-cli wants a folder holding a .ino of the same name
+sketch="$work/Morse_Convertor"
+mkdir "$sketch"
+cp "$root"/Morse_*.h "$sketch"/
+cp "$root/Morse_Convertor_rev4.c" "$sketch/Morse_Convertor.ino"
+
+printf '%-10s %8s %8s\n' config flash sram
+echo "$configs" | while read -r name flags; do
+  if ! out=$(arduino-cli compile --fqbn "$fqbn" \
+               --build-property "compiler.cpp.extra_flags=$flags" "$sketch" 2>&1); then
+    printf '%-10s %8s %8s\n' "$name" failed -
+    echo "$out" | grep -m 5 error >&2 || true
+    continue
+  fi
+  flash=$(echo "$out" | sed -n 's/^Sketch uses \([0-9]*\) bytes.*/\1/p')
+  sram=$(echo "$out" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+  printf '%-10s %8s %8s\n' "$name" "$flash" "$sram"
+done
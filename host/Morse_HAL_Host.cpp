@@ -0,0 +1,631 @@
+/*
+   Virtual clock, pin recorder, Serial and LCD models behind Morse_HAL_Host.h.
+*/
+
+#include "Morse_HAL_Host.h"
+
+#include <stdio.h>
+#include <deque>
+
+HardwareSerial Serial;
+
+static uint8_t pinLevel[20];
+
+namespace sim {
+
+uint32_t lcdCommandUs = 40;
+uint32_t lcdClearUs = 1520;
+
+std::vector<Event> events;
+
+static uint64_t clockUs = 0;
+static unsigned long baudRate = 9600;
+
+// Bytes on their way in, each with the time its stop bit arrives
+struct PendingByte {
+  uint64_t us;
+  uint8_t value;
+};
+static std::deque<PendingByte> rxLine;
+static uint8_t rxBuffer[serialRxBufferSize];
+static int rxHead = 0;
+static int rxCount = 0;
+static uint32_t rxDropped = 0;
+
+static bool flowControl = true;
+static bool rxPaused = false;  // Sender stopped by XOFF
+static uint64_t rxPausedSince = 0;
+static uint64_t rxPausedTotal = 0;
+
+static uint64_t txBusyUntil = 0;  // When the last queued TX byte leaves
+static std::string txLog;
+
+static bool toneActive = false;
+static uint8_t tonePin = 0;
+static uint64_t toneStopUs = 0;  // 0 when the tone has no duration
+
+static LiquidCrystal* display = NULL;
+
+static std::vector<AudioSample> audioLog;
+
+static uint64_t asleepTotal = 0;
+
+static uint8_t eepromData[E2END + 1];
+static bool eepromBlank = true;  // Not yet filled with 0xFF
+static uint64_t eepromReadyUs = 0;
+static const uint32_t eepromWriteUs = 3400;
+
+static long heapUsed = 0;
+static long heapPeak = 0;
+
+struct Timer {
+  uint32_t periodUs;
+  uint64_t nextUs;
+  void (*isr)();
+};
+static std::vector<Timer> timers;
+
+struct PinEdge {
+  uint64_t us;
+  uint8_t pin;
+  uint8_t level;
+};
+static std::deque<PinEdge> pinEdges;
+static void (*pinChangeIsr[sizeof(pinLevel)])();
+static bool interruptsEnabled = true;
+
+static void record(EventKind kind, uint8_t pin, int32_t value) {
+  Event e = { clockUs, kind, pin, value };
+  events.push_back(e);
+}
+
+// One start bit, eight data bits, one stop bit
+static uint32_t byteTimeUs() {
+  return (uint32_t)(10000000UL / baudRate);
+}
+
+void reset() {
+  events.clear();
+  clockUs = 0;
+  baudRate = 9600;
+  rxLine.clear();
+  rxHead = 0;
+  rxCount = 0;
+  rxDropped = 0;
+  flowControl = true;
+  rxPaused = false;
+  rxPausedTotal = 0;
+  txBusyUntil = 0;
+  txLog.clear();
+  toneActive = false;
+  toneStopUs = 0;
+  timers.clear();
+  pinEdges.clear();
+  memset(pinChangeIsr, 0, sizeof(pinChangeIsr));
+  memset(pinLevel, 0, sizeof(pinLevel));
+  interruptsEnabled = true;
+  asleepTotal = 0;
+  eepromReadyUs = 0;
+  audioLog.clear();
+  heapPeak = heapUsed;
+  if (display != NULL) {
+    memset(display->ram, ' ', sizeof(display->ram));
+    display->cursorCol = 0;
+    display->cursorRow = 0;
+  }
+}
+
+uint64_t now() {
+  return clockUs;
+}
+
+static void receiveByte(uint8_t value) {
+  if (rxCount == serialRxBufferSize) {
+    rxDropped++;
+    record(EV_SERIAL_DROP, 0, value);
+  } else {
+    rxBuffer[(rxHead + rxCount) % serialRxBufferSize] = value;
+    rxCount++;
+    record(EV_SERIAL_RX, 0, value);
+  }
+}
+
+enum NextEvent { NONE, RX, TONE_END, TIMER, PIN_EDGE };
+
+// Runs whatever falls due next up to target, in time order. Returns what
+// it ran, NONE when nothing is left before target.
+static NextEvent runNextEvent(uint64_t target) {
+  NextEvent what = NONE;
+  uint64_t when = target + 1;
+  size_t timer = 0;
+
+  if (!rxPaused && !rxLine.empty() && rxLine.front().us < when) {
+    what = RX;
+    when = rxLine.front().us;
+  }
+  if (toneActive && toneStopUs != 0 && toneStopUs < when) {
+    what = TONE_END;
+    when = toneStopUs;
+  }
+  if (interruptsEnabled && !pinEdges.empty() && pinEdges.front().us < when) {
+    what = PIN_EDGE;
+    when = pinEdges.front().us;
+  }
+  if (interruptsEnabled) {
+    for (size_t i = 0; i < timers.size(); i++) {
+      if (timers[i].nextUs < when) {
+        what = TIMER;
+        when = timers[i].nextUs;
+        timer = i;
+      }
+    }
+  }
+  if (what == NONE) {
+    return NONE;
+  }
+
+  if (when > clockUs) {
+    clockUs = when;
+  }
+  switch (what) {
+    case RX:
+      receiveByte(rxLine.front().value);
+      rxLine.pop_front();
+      break;
+    case TONE_END:
+      toneActive = false;
+      record(EV_NO_TONE, tonePin, 0);
+      break;
+    case PIN_EDGE: {
+      PinEdge e = pinEdges.front();
+      pinEdges.pop_front();
+      bool changed = pinLevel[e.pin] != e.level;
+      pinLevel[e.pin] = e.level;
+      record(EV_PIN_INPUT, e.pin, e.level);
+      if (changed && pinChangeIsr[e.pin] != NULL) {
+        interruptsEnabled = false;
+        pinChangeIsr[e.pin]();
+        interruptsEnabled = true;
+      }
+      break;
+    }
+    case TIMER:
+      timers[timer].nextUs += timers[timer].periodUs;
+      interruptsEnabled = false;  // The AVR masks interrupts inside an ISR
+      timers[timer].isr();
+      interruptsEnabled = true;
+      break;
+    default:
+      break;
+  }
+  return what;
+}
+
+void advance(uint32_t us) {
+  uint64_t target = clockUs + us;
+  while (runNextEvent(target) != NONE) {
+  }
+  clockUs = target;
+}
+
+void sleepUntilInterrupt() {
+  uint64_t start = clockUs;
+  NextEvent woken;
+  do {
+    woken = runNextEvent(UINT64_MAX - 1);  // The end of a timed tone() is no interrupt here
+  } while (woken == TONE_END);
+  asleepTotal += clockUs - start;
+}
+
+uint64_t asleepUs() {
+  return asleepTotal;
+}
+
+void attachTimer(uint32_t periodUs, void (*isr)()) {
+  Timer t = { periodUs, clockUs + periodUs, isr };
+  timers.push_back(t);
+}
+
+void detachTimer(void (*isr)()) {
+  for (size_t i = 0; i < timers.size(); i++) {
+    if (timers[i].isr == isr) {
+      timers.erase(timers.begin() + i);
+      return;
+    }
+  }
+}
+
+void attachPinChange(uint8_t pin, void (*isr)()) {
+  if (pin < sizeof(pinLevel)) {
+    pinChangeIsr[pin] = isr;
+  }
+}
+
+void pinInput(uint8_t pin, uint8_t level, uint64_t atUs) {
+  if (pin < sizeof(pinLevel)) {
+    PinEdge e = { atUs, pin, (uint8_t)(level ? HIGH : LOW) };
+    pinEdges.push_back(e);
+  }
+}
+
+void serialFeed(const char* data, size_t length, uint64_t atUs) {
+  uint64_t t = atUs;
+  if (!rxLine.empty() && rxLine.back().us > t) {
+    t = rxLine.back().us;
+  }
+  for (size_t i = 0; i < length; i++) {
+    t += byteTimeUs();
+    PendingByte b = { t, (uint8_t)data[i] };
+    rxLine.push_back(b);
+  }
+}
+
+size_t serialPending() {
+  return rxLine.size() + rxCount;
+}
+
+void serialFlowControl(bool enabled) {
+  flowControl = enabled;
+}
+
+uint64_t serialPausedUs() {
+  return rxPausedTotal + (rxPaused ? clockUs - rxPausedSince : 0);
+}
+
+// The sender reacts once the flow control byte has fully arrived. On XON
+// everything still to be sent slides later by the length of the pause.
+static void senderFlowControl(uint8_t c, uint64_t arrivalUs) {
+  if (!flowControl) {
+    return;
+  }
+  if (c == 0x13 && !rxPaused) {
+    rxPaused = true;
+    rxPausedSince = arrivalUs;
+  } else if (c == 0x11 && rxPaused) {
+    rxPaused = false;
+    uint64_t pause = arrivalUs > rxPausedSince ? arrivalUs - rxPausedSince : 0;
+    rxPausedTotal += pause;
+    for (size_t i = 0; i < rxLine.size(); i++) {
+      if (rxLine[i].us > rxPausedSince) {
+        rxLine[i].us += pause;
+      }
+    }
+  }
+}
+
+uint32_t serialDropped() {
+  return rxDropped;
+}
+
+void heapChange(long bytes) {
+  heapUsed += bytes;
+  if (heapUsed > heapPeak) {
+    heapPeak = heapUsed;
+  }
+}
+
+uint32_t heapInUse() {
+  return (uint32_t)heapUsed;
+}
+
+uint32_t heapHighWater() {
+  return (uint32_t)heapPeak;
+}
+
+void audioSample(uint8_t level) {
+  AudioSample sample = { clockUs, level };
+  audioLog.push_back(sample);
+}
+
+const std::vector<AudioSample>& audio() {
+  return audioLog;
+}
+
+const std::string& serialOutput() {
+  return txLog;
+}
+
+std::string lcdRow(int row) {
+  if (display == NULL || row < 0 || row > 1) {
+    return std::string();
+  }
+  return std::string(display->ram[row], display->cols);
+}
+
+uint8_t* eeprom() {
+  if (eepromBlank) {
+    memset(eepromData, 0xFF, sizeof(eepromData));
+    eepromBlank = false;
+  }
+  return eepromData;
+}
+
+bool eepromReady() {
+  return clockUs >= eepromReadyUs;
+}
+
+// Busy-wait, with interrupts still running, for a write in progress
+void eepromWait() {
+  if (clockUs < eepromReadyUs) {
+    advance((uint32_t)(eepromReadyUs - clockUs));
+  }
+}
+
+void eepromWrite(uint16_t addr, uint8_t value) {
+  eepromWait();
+  eeprom()[addr] = value;
+  eepromReadyUs = clockUs + eepromWriteUs;
+  record(EV_EEPROM_WRITE, 0, (int32_t)addr << 8 | value);
+}
+
+const char* eventName(EventKind kind) {
+  switch (kind) {
+    case EV_PIN_MODE: return "pinMode";
+    case EV_DIGITAL_WRITE: return "digitalWrite";
+    case EV_ANALOG_WRITE: return "analogWrite";
+    case EV_TONE: return "tone";
+    case EV_NO_TONE: return "noTone";
+    case EV_LCD_CLEAR: return "lcdClear";
+    case EV_LCD_CURSOR: return "lcdCursor";
+    case EV_LCD_WRITE: return "lcdWrite";
+    case EV_SERIAL_TX: return "serialTx";
+    case EV_SERIAL_RX: return "serialRx";
+    case EV_SERIAL_DROP: return "serialDrop";
+    case EV_PIN_INPUT: return "pinInput";
+    case EV_EEPROM_WRITE: return "eepromWrite";
+  }
+  return "?";
+}
+
+// Called by the Serial and LCD models below
+void recordEvent(EventKind kind, uint8_t pin, int32_t value) {
+  record(kind, pin, value);
+}
+
+void setBaud(unsigned long baud) {
+  baudRate = baud != 0 ? baud : 9600;
+}
+
+int rxAvailable() {
+  return rxCount;
+}
+
+int rxPeek() {
+  return rxCount == 0 ? -1 : rxBuffer[rxHead];
+}
+
+int rxRead() {
+  if (rxCount == 0) {
+    return -1;
+  }
+  uint8_t c = rxBuffer[rxHead];
+  rxHead = (rxHead + 1) % serialRxBufferSize;
+  rxCount--;
+  return c;
+}
+
+// The AVR core has a 64 byte TX buffer; a write only blocks once it is full
+void txByte(uint8_t c) {
+  uint64_t byteUs = byteTimeUs();
+  if (txBusyUntil < clockUs) {
+    txBusyUntil = clockUs;
+  }
+  if (txBusyUntil - clockUs > 64 * byteUs) {
+    advance((uint32_t)(txBusyUntil - clockUs - 64 * byteUs));
+  }
+  txBusyUntil += byteUs;
+  senderFlowControl(c, txBusyUntil);
+  txLog += (char)c;
+  record(EV_SERIAL_TX, 0, c);
+}
+
+void txFlush() {
+  if (txBusyUntil > clockUs) {
+    advance((uint32_t)(txBusyUntil - clockUs));
+  }
+}
+
+void startTone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  if (toneActive && pin != tonePin) {
+    return;  // The Uno has one tone timer, and tone() ignores a second pin
+  }
+  toneActive = true;
+  tonePin = pin;
+  toneStopUs = duration != 0 ? clockUs + duration * 1000ULL : 0;
+  record(EV_TONE, pin, frequency);
+}
+
+void stopTone(uint8_t pin) {
+  if (toneActive && pin == tonePin) {
+    toneActive = false;
+  }
+  record(EV_NO_TONE, pin, 0);
+}
+
+void setInterrupts(bool enabled) {
+  interruptsEnabled = enabled;
+}
+
+void attachDisplay(LiquidCrystal* lcd) {
+  display = lcd;
+}
+
+}  // namespace sim
+
+unsigned long millis() {
+  return (unsigned long)(sim::now() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)sim::now();
+}
+
+void delay(unsigned long ms) {
+  sim::advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance(us);
+}
+
+uint8_t eeprom_read_byte(const uint8_t* addr) {
+  sim::eepromWait();
+  return sim::eeprom()[(uintptr_t)addr & E2END];
+}
+
+// Like avr-libc's, writes only if the byte differs, saving wear and time
+void eeprom_update_byte(uint8_t* addr, uint8_t value) {
+  uint16_t a = (uintptr_t)addr & E2END;
+  if (eeprom_read_byte(addr) != value) {
+    sim::eepromWrite(a, value);
+  }
+}
+
+bool eeprom_is_ready() {
+  return sim::eepromReady();
+}
+
+void noInterrupts() {
+  sim::setInterrupts(false);
+}
+
+void interrupts() {
+  sim::setInterrupts(true);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < sizeof(pinLevel) && mode == INPUT_PULLUP) {
+    pinLevel[pin] = HIGH;
+  }
+  sim::recordEvent(sim::EV_PIN_MODE, pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < sizeof(pinLevel)) {
+    pinLevel[pin] = value ? HIGH : LOW;
+  }
+  sim::recordEvent(sim::EV_DIGITAL_WRITE, pin, value ? HIGH : LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < sizeof(pinLevel) ? pinLevel[pin] : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  if (pin < sizeof(pinLevel)) {
+    pinLevel[pin] = value > 127 ? HIGH : LOW;
+  }
+  sim::recordEvent(sim::EV_ANALOG_WRITE, pin, value);
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  sim::startTone(pin, frequency, duration);
+}
+
+void noTone(uint8_t pin) {
+  sim::stopTone(pin);
+}
+
+size_t Print::write(const char* s) {
+  size_t n = 0;
+  while (*s) {
+    n += write((uint8_t)*s++);
+  }
+  return n;
+}
+
+size_t Print::print(long n, int base) {
+  if (base == 10) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%ld", n);
+    return write(buf);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  char* p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    unsigned long digit = n % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n != 0);
+  return write(p);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  sim::setBaud(baud);
+}
+
+int HardwareSerial::available() {
+  return sim::rxAvailable();
+}
+
+int HardwareSerial::peek() {
+  return sim::rxPeek();
+}
+
+int HardwareSerial::read() {
+  return sim::rxRead();
+}
+
+void HardwareSerial::flush() {
+  sim::txFlush();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  sim::txByte(c);
+  return 1;
+}
+
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {
+  memset(ram, ' ', sizeof(ram));
+  sim::attachDisplay(this);
+}
+
+void LiquidCrystal::begin(uint8_t c, uint8_t r) {
+  cols = c;
+  rows = r;
+  clear();
+}
+
+void LiquidCrystal::clear() {
+  memset(ram, ' ', sizeof(ram));
+  cursorCol = 0;
+  cursorRow = 0;
+  sim::recordEvent(sim::EV_LCD_CLEAR, 0, 0);
+  sim::advance(sim::lcdClearUs);
+}
+
+void LiquidCrystal::home() {
+  cursorCol = 0;
+  cursorRow = 0;
+  sim::recordEvent(sim::EV_LCD_CURSOR, 0, 0);
+  sim::advance(sim::lcdClearUs);
+}
+
+void LiquidCrystal::setCursor(uint8_t col, uint8_t row) {
+  cursorCol = col < 40 ? col : 39;
+  cursorRow = row < 2 ? row : 1;
+  sim::recordEvent(sim::EV_LCD_CURSOR, col, row);
+  sim::advance(sim::lcdCommandUs);
+}
+
+size_t LiquidCrystal::write(uint8_t c) {
+  ram[cursorRow][cursorCol] = c;
+  cursorCol = (cursorCol + 1) % 40;  // The address counter wraps at 40
+  sim::recordEvent(sim::EV_LCD_WRITE, 0, c);
+  sim::advance(sim::lcdCommandUs);
+  return 1;
+}
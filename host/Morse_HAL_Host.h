@@ -0,0 +1,282 @@
+/*
+   Host (Linux) implementation of the Arduino calls used by the sketches.
+
+   Time is virtual: delay() and the simulator's loop driver move the clock
+   forward instead of sleeping, so a session of several minutes runs in a
+   few milliseconds of wall time. Every pin change, tone, LCD command and
+   Serial byte is appended to sim::events with its virtual timestamp.
+*/
+
+#ifndef MORSE_HAL_HOST_H
+#define MORSE_HAL_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+// The Uno's analog inputs, usable as digital pins
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Flash and RAM share one address space on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+// EEPROM, as avr/eeprom.h has it on the Uno: E2END + 1 bytes that start
+// blank (0xFF) and keep their contents across sim::reset(). A write takes
+// 3.4 ms of virtual time; eeprom_is_ready() is false until it is done, and
+// a read or write meanwhile waits for it, as on the chip.
+#define E2END 0x3FF
+uint8_t eeprom_read_byte(const uint8_t* addr);
+void eeprom_update_byte(uint8_t* addr, uint8_t value);
+bool eeprom_is_ready();
+
+// Hold back simulated interrupts, as cli()/sei() would
+void noInterrupts();
+void interrupts();
+
+namespace sim {
+// Called by String as its buffer is allocated, grown and freed
+void heapChange(long bytes);
+}
+
+// Just enough of Arduino's String for the sketches that still use it.
+// Heap use is modelled on the AVR core: the buffer is reallocated to the
+// exact length needed whenever it grows, never shrinks, and each block
+// costs two bytes of malloc() header.
+class String {
+public:
+  String(const char* s = "") : str(s) { track(); }
+  String(const std::string& s) : str(s) { track(); }
+  String(const String& s) : str(s.str) { track(); }
+  ~String() {
+    if (reserved > 0) {
+      sim::heapChange(-(long)(reserved + mallocHeader));
+    }
+  }
+
+  String& operator=(const char* s) { str = s; track(); return *this; }
+  String& operator=(const String& s) { str = s.str; track(); return *this; }
+  String& operator+=(char c) { str += c; track(); return *this; }
+  String& operator+=(const char* s) { str += s; track(); return *this; }
+  String& operator+=(const String& s) { str += s.str; track(); return *this; }
+
+  unsigned int length() const { return str.size(); }
+  char charAt(unsigned int i) const { return i < str.size() ? str[i] : 0; }
+  const char* c_str() const { return str.c_str(); }
+  String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to && from < str.size() ? String(str.substr(from, to - from)) : String();
+  }
+
+private:
+  static const size_t mallocHeader = 2;
+
+  void track() {
+    size_t needed = str.size() + 1;
+    if (needed > reserved) {
+      sim::heapChange((long)(needed - reserved + (reserved == 0 ? mallocHeader : 0)));
+      reserved = needed;
+    }
+  }
+
+  std::string str;
+  size_t reserved = 0;  // Bytes of buffer the AVR String would hold
+};
+
+// Base class for anything that can be printed to, as in the Arduino core
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+
+  size_t write(const char* s);
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long n, int base = 10);
+  size_t print(unsigned long n, int base = 10);
+  size_t print(int n, int base = 10) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = 10) { return print((unsigned long)n, base); }
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  template <typename T> size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud);
+  void end() {}
+  int available();
+  int peek();
+  int read();
+  void flush();
+  using Print::write;
+  size_t write(uint8_t c) override;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// HD44780 model: 40 columns of display RAM per row, first cols shown
+class LiquidCrystal : public Print {
+public:
+  LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7);
+
+  void begin(uint8_t cols, uint8_t rows);
+  void clear();
+  void home();
+  void setCursor(uint8_t col, uint8_t row);
+  using Print::write;
+  size_t write(uint8_t c) override;
+
+  uint8_t cols = 16;
+  uint8_t rows = 2;
+  uint8_t cursorCol = 0;
+  uint8_t cursorRow = 0;
+  char ram[2][40];
+};
+
+namespace sim {
+
+enum EventKind : uint8_t {
+  EV_PIN_MODE,       // pin, value = mode
+  EV_DIGITAL_WRITE,  // pin, value = HIGH/LOW
+  EV_ANALOG_WRITE,   // pin, value = duty 0-255
+  EV_TONE,           // pin, value = frequency in Hz
+  EV_NO_TONE,        // pin
+  EV_LCD_CLEAR,
+  EV_LCD_CURSOR,     // pin = column, value = row
+  EV_LCD_WRITE,      // value = character
+  EV_SERIAL_TX,      // value = byte sent by the sketch
+  EV_SERIAL_RX,      // value = byte placed in the RX buffer
+  EV_SERIAL_DROP,    // value = byte lost because the RX buffer was full
+  EV_PIN_INPUT,      // pin, value = level driven onto an input from outside
+  EV_EEPROM_WRITE    // value = address << 8 | byte written
+};
+
+struct Event {
+  uint64_t us;
+  EventKind kind;
+  uint8_t pin;
+  int32_t value;
+};
+
+// Simulated cost of hardware operations, in microseconds
+extern uint32_t lcdCommandUs;  // Each character or cursor move (about 40us)
+extern uint32_t lcdClearUs;    // clear() and home() (about 1.52ms)
+
+const int serialRxBufferSize = 64;  // Same as the AVR core
+
+extern std::vector<Event> events;
+
+// Reset the clock, the pins, the LCD and the serial buffers. The EEPROM
+// keeps its contents, as it does through a real reset.
+void reset();
+
+// The EEPROM's contents, E2END + 1 bytes, for loading and saving an image
+uint8_t* eeprom();
+
+// Current virtual time in microseconds
+uint64_t now();
+
+// Move the virtual clock forward, delivering serial bytes as they arrive
+// and running timer interrupts as they fall due
+void advance(uint32_t us);
+
+// Sleep as the AVR's IDLE mode does: move the clock on to the next
+// interrupt (a timer, a byte arriving on RX or a pin change), run it and
+// return. Returns at once if no interrupt can ever come.
+void sleepUntilInterrupt();
+
+// Total virtual time spent in sleepUntilInterrupt() since reset()
+uint64_t asleepUs();
+
+// Call isr every periodUs of virtual time, like a hardware timer interrupt.
+// reset() detaches all timers.
+void attachTimer(uint32_t periodUs, void (*isr)());
+
+// Stop calling isr, as clearing a timer's interrupt enable would
+void detachTimer(void (*isr)());
+
+// Call isr whenever an input edge changes the level of pin
+void attachPinChange(uint8_t pin, void (*isr)());
+
+// Drive an input pin to level at time atUs, as a key or switch would.
+// Edges must be scheduled in time order.
+void pinInput(uint8_t pin, uint8_t level, uint64_t atUs);
+
+// Queue text to arrive on the RX line back to back, starting at atUs,
+// at the baud rate the sketch passed to Serial.begin()
+void serialFeed(const char* data, size_t length, uint64_t atUs);
+
+// Bytes queued with serialFeed() that have not reached the RX buffer yet
+size_t serialPending();
+
+// When enabled (the default) the simulated sender honours XON/XOFF: it
+// stops after an XOFF from the sketch and carries on after the next XON
+void serialFlowControl(bool enabled);
+
+// Total time the sender has spent paused by XOFF
+uint64_t serialPausedUs();
+
+// Number of bytes lost to RX buffer overflow since reset()
+uint32_t serialDropped();
+
+// Bytes of heap held by String objects now, and the most held at any
+// point since reset() (which starts the high-water mark at the current use)
+uint32_t heapInUse();
+uint32_t heapHighWater();
+
+// A PWM audio output set to level (0-255) now. The sidetone calls this
+// for every sample, and audio() has them all since reset().
+struct AudioSample {
+  uint64_t us;
+  uint8_t level;
+};
+void audioSample(uint8_t level);
+const std::vector<AudioSample>& audio();
+
+// Everything the sketch has printed to Serial
+const std::string& serialOutput();
+
+// The visible part of an LCD row, as a string of lcd.cols characters
+std::string lcdRow(int row);
+
+const char* eventName(EventKind kind);
+
+}  // namespace sim
+
+#endif
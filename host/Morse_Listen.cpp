@@ -0,0 +1,187 @@
+/*
+   Command line Morse audio decoder: WAV files in, text out.
+
+   Build (from the repository root):
+     g++ -std=c++17 -O3 -pthread -I. host/Morse_Listener.cpp \
+         host/Morse_Listen.cpp -o morse_listen
+
+   Usage:
+     ./morse_listen [options] [file...]   "-" or no file reads stdin
+
+     -p HZ       listen at this pitch instead of searching for it
+     -l LOW-HIGH pitch search range in Hz (default 200-3000)
+     -b MS       shortest detector block (default 4); blocks grow to
+                 about a sixth of a dot for slow senders, up to 12 ms
+     -j N        decode N files at a time (default one per core)
+     -q          do not print the summary
+
+   Each file's text goes to stdout on one line, after its name when there
+   is more than one file, in the order given however the threads finish.
+   The summary on stderr gives each file's pitch and speed and the
+   decoding speed against real time. Input is 8-bit or 16-bit PCM, any
+   rate and channel count, such as morse_render or morse_sim --wav write.
+*/
+
+#include "Morse_Listener.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t readSamples = 16384;  // Samples read and decoded at a time
+
+struct Decoded {
+  std::string text;
+  std::string error;
+  double pitchHz = 0;
+  unsigned wpm = 0;
+  double seconds = 0;  // Length of the audio
+  bool truncated = false;
+};
+
+static void usage() {
+  fprintf(stderr, "usage: morse_listen [-p hz] [-l low-high] [-b ms] [-j threads] [-q] [file...]\n");
+  exit(2);
+}
+
+static Decoded decodeFile(const char* path, const morse::ListenSettings& settings) {
+  Decoded result;
+  bool isStdin = strcmp(path, "-") == 0;
+  FILE* f = isStdin ? stdin : fopen(path, "rb");
+  if (f == nullptr) {
+    result.error = strerror(errno);
+    return result;
+  }
+
+  morse::WavReader wav;
+  if (wav.open(f, result.error)) {
+    morse::Listener listener(wav.sampleRate(), settings);
+    std::vector<float> samples(readSamples);
+    uint64_t total = 0;
+    for (size_t n; (n = wav.read(samples.data(), samples.size())) != 0; ) {
+      listener.feed(samples.data(), n, result.text);
+      total += n;
+    }
+    listener.finish(result.text);
+    result.pitchHz = listener.pitch();
+    result.wpm = listener.wpm();
+    result.seconds = (double)total / wav.sampleRate();
+    result.truncated = wav.failed();
+  }
+  if (!isStdin) {
+    fclose(f);
+  }
+  return result;
+}
+
+int main(int argc, char** argv) {
+  morse::ListenSettings settings;
+  unsigned threads = std::thread::hardware_concurrency();
+  std::vector<const char*> paths;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "-p" && hasValue) {
+      settings.pitchHz = atof(argv[++i]);
+    } else if (arg == "-l" && hasValue) {
+      if (sscanf(argv[++i], "%lf-%lf", &settings.minPitchHz, &settings.maxPitchHz) != 2) {
+        usage();
+      }
+    } else if (arg == "-b" && hasValue) {
+      settings.blockMs = atof(argv[++i]);
+    } else if (arg == "-j" && hasValue) {
+      threads = (unsigned)atoi(argv[++i]);
+    } else if (arg == "-q") {
+      quiet = true;
+    } else if (arg[0] == '-' && arg != "-") {
+      usage();
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    paths.push_back("-");
+  }
+  if (settings.pitchHz < 0 || settings.minPitchHz <= 0 || settings.maxPitchHz < settings.minPitchHz ||
+      settings.blockMs < 1 || settings.blockMs > 50) {
+    fprintf(stderr, "morse_listen: settings out of range\n");
+    return 2;
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+  if (threads > paths.size()) {
+    threads = (unsigned)paths.size();
+  }
+
+  // Workers take the next file as they come free. Each result is printed
+  // as soon as it and every one before it are done, so the output keeps
+  // the order of the arguments.
+  std::vector<Decoded> results(paths.size());
+  std::vector<bool> done(paths.size());
+  std::atomic<size_t> next(0);
+  std::mutex printLock;
+  size_t printed = 0;
+  bool failed = false;
+  double audioSeconds = 0;
+
+  auto print = [&](size_t i) {
+    const Decoded& r = results[i];
+    const char* name = paths[i];
+    if (!r.error.empty()) {
+      fflush(stdout);
+      fprintf(stderr, "morse_listen: %s: %s\n", name, r.error.c_str());
+      failed = true;
+      return;
+    }
+    if (paths.size() > 1) {
+      printf("%s: ", name);
+    }
+    printf("%s\n", r.text.c_str());
+    fflush(stdout);  // Ahead of anything more on stderr
+    if (r.truncated) {
+      fprintf(stderr, "morse_listen: %s: file ends early\n", name);
+    }
+    if (!quiet) {
+      fprintf(stderr, "%s: %.1f s, %.0f Hz, %u wpm\n", name, r.seconds, r.pitchHz, r.wpm);
+    }
+    audioSeconds += r.seconds;
+  };
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&] {
+      for (size_t i; (i = next++) < paths.size(); ) {
+        Decoded r = decodeFile(paths[i], settings);
+        std::lock_guard<std::mutex> lock(printLock);
+        results[i] = std::move(r);
+        done[i] = true;
+        for (; printed < paths.size() && done[printed]; printed++) {
+          print(printed);
+          results[printed] = Decoded();  // Free the text once it is out
+        }
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (!quiet) {
+    fprintf(stderr, "%zu file%s, %.1f s of audio in %.3f s, %.0fx real time, %u thread%s\n",
+            paths.size(), paths.size() == 1 ? "" : "s", audioSeconds, seconds,
+            seconds > 0 ? audioSeconds / seconds : 0.0, threads, threads == 1 ? "" : "s");
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,473 @@
+/*
+   WAV reading, Goertzel filter bank and key detector behind
+   Morse_Listener.h.
+*/
+
+#include "Morse_Listener.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "../Morse_Unicode.h"
+
+namespace morse {
+
+static const uint64_t unknownLength = UINT64_MAX;  // Data chunk size not filled in
+static const float silence = 1e-3f;  // Amplitudes below this (-60 dBFS) are no signal
+
+static uint16_t get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+bool WavReader::readExact(void* out, size_t n) {
+  return fread(out, 1, n, file) == n;
+}
+
+bool WavReader::open(FILE* f, std::string& error) {
+  file = f;
+  uint8_t h[12];
+  if (!readExact(h, sizeof(h)) || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) {
+    error = "not a WAV file";
+    return false;
+  }
+
+  bool haveFormat = false;
+  for (;;) {
+    uint8_t chunk[8];
+    if (!readExact(chunk, sizeof(chunk))) {
+      error = "no sample data";
+      return false;
+    }
+    uint32_t size = get32(chunk + 4);
+
+    if (memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat) {
+        error = "sample data before the format";
+        return false;
+      }
+      // A writer that could not seek back may leave the size 0 or maximal
+      remaining = size == 0 || size == 0xFFFFFFFF ? unknownLength : size;
+      return true;
+    }
+
+    // Read the format, or skip any other chunk without seeking, so the
+    // input can be a pipe
+    uint8_t body[40];
+    uint32_t left = size + (size & 1);  // Chunks are padded to even sizes
+    uint32_t kept = memcmp(chunk, "fmt ", 4) == 0 ? std::min<uint32_t>(left, sizeof(body)) : 0;
+    if (!readExact(body, kept)) {
+      error = "truncated header";
+      return false;
+    }
+    for (left -= kept; left > 0; ) {
+      uint8_t skip[256];
+      uint32_t n = std::min<uint32_t>(left, sizeof(skip));
+      if (!readExact(skip, n)) {
+        error = "truncated header";
+        return false;
+      }
+      left -= n;
+    }
+    if (kept == 0) {
+      continue;
+    }
+
+    if (size < 16) {
+      error = "bad format chunk";
+      return false;
+    }
+    uint16_t format = get16(body);
+    if (format == 0xFFFE && size >= 26) {
+      format = get16(body + 24);  // WAVE_FORMAT_EXTENSIBLE: the sub-format's tag
+    }
+    channels = get16(body + 2);
+    rate = get32(body + 4);
+    uint16_t bits = get16(body + 14);
+    if (format != 1 || (bits != 8 && bits != 16) || channels == 0 || rate == 0) {
+      error = "not 8-bit or 16-bit PCM";
+      return false;
+    }
+    bytesPerSample = bits / 8;
+    haveFormat = true;
+  }
+}
+
+size_t WavReader::read(float* out, size_t max) {
+  size_t frameBytes = (size_t)channels * bytesPerSample;
+  size_t frames = remaining / frameBytes < max ? (size_t)(remaining / frameBytes) : max;
+  if (frames == 0) {
+    return 0;
+  }
+  raw.resize(frames * frameBytes);
+  size_t got = fread(raw.data(), 1, raw.size(), file);
+  if (got < raw.size()) {
+    readFailed = ferror(file) || remaining != unknownLength;
+    remaining = 0;
+  } else if (remaining != unknownLength) {
+    remaining -= got;
+  }
+
+  frames = got / frameBytes;
+  const uint8_t* p = raw.data();
+  float scale = 1.0f / channels;
+  for (size_t i = 0; i < frames; i++) {
+    float sum = 0;
+    for (uint16_t c = 0; c < channels; c++) {
+      if (bytesPerSample == 1) {
+        sum += (*p - 128) / 128.0f;  // 8-bit samples are unsigned
+      } else {
+        sum += (int16_t)get16(p) / 32768.0f;
+      }
+      p += bytesPerSample;
+    }
+    out[i] = sum * scale;
+  }
+  return frames;
+}
+
+Listener::Listener(uint32_t sampleRate, const ListenSettings& settings) : rate(sampleRate), settings(settings) {
+  shortestBlock = std::max<size_t>(16, (size_t)lround(rate * settings.blockMs / 1000));
+  longestBlock = std::max<size_t>(shortestBlock, (size_t)lround(rate * settings.maxBlockMs / 1000));
+  setBlock(shortestBlock);
+  searchBlocks = (uint64_t)(settings.searchMs * rate / 1000 / shortestBlock);
+  maxSearchBlocks = (uint64_t)(settings.maxSearchMs * rate / 1000 / shortestBlock);
+
+  // A given pitch still goes through the search, with one filter, to set
+  // the levels the detector starts from
+  searching = true;
+  pitchHz = settings.pitchHz;
+  if (pitchHz > 0) {
+    setFilters({ pitchHz });
+    quietest.assign(1, HUGE_VALF);
+    return;
+  }
+  // A filter passes about rate / blockSamples either side of its
+  // frequency; a quarter of that apart, one of them is always close
+  double binHz = (double)rate / blockSamples;
+  double top = std::min(settings.maxPitchHz, rate / 2.0 - binHz);
+  std::vector<double> hz;
+  for (double f = settings.minPitchHz; f <= top; f += binHz / 4) {
+    hz.push_back(f);
+  }
+  if (hz.empty()) {
+    hz.push_back(settings.minPitchHz);
+  }
+  setFilters(hz);
+  quietest.assign(hz.size(), HUGE_VALF);
+}
+
+void Listener::setBlock(size_t samples) {
+  blockSamples = samples;
+  double blockS = (double)samples / rate;
+  signalFall = (float)exp(-blockS / 2.0);  // Falls by 1/e in 2 s
+  noiseRise = (float)(1 - exp(-blockS / 5.0));  // Rises by 1 - 1/e in 5 s
+}
+
+void Listener::setFilters(const std::vector<double>& hz) {
+  filterHz = hz;
+  coefficient.resize(hz.size());
+  for (size_t k = 0; k < hz.size(); k++) {
+    coefficient[k] = (float)(2 * cos(2 * M_PI * hz[k] / rate));
+  }
+  s1.assign(hz.size(), 0);
+  s2.assign(hz.size(), 0);
+}
+
+void Listener::filter(const float* samples, size_t n) {
+  size_t count = coefficient.size();
+  if (count == 1) {
+    float c = coefficient[0];
+    float a = s1[0];
+    float b = s2[0];
+    for (size_t i = 0; i < n; i++) {
+      float s = samples[i] + c * a - b;
+      b = a;
+      a = s;
+    }
+    s1[0] = a;
+    s2[0] = b;
+    return;
+  }
+  // Frequencies innermost, so the compiler can vectorise across the bank
+  float* c = coefficient.data();
+  float* a = s1.data();
+  float* b = s2.data();
+  for (size_t i = 0; i < n; i++) {
+    float x = samples[i];
+    for (size_t k = 0; k < count; k++) {
+      float s = x + c[k] * a[k] - b[k];
+      b[k] = a[k];
+      a[k] = s;
+    }
+  }
+}
+
+void Listener::feed(const float* samples, size_t n, std::string& text) {
+  while (n > 0) {
+    size_t m = std::min(n, blockSamples - used);
+    filter(samples, m);
+    samples += m;
+    n -= m;
+    used += m;
+    if (used == blockSamples) {
+      endBlock(text);
+    }
+  }
+}
+
+void Listener::endBlock(std::string& text) {
+  size_t count = coefficient.size();
+  size_t first = history.size();
+  uint64_t start = position;
+  position += blockSamples;
+  float scale = 2.0f / blockSamples;  // To the amplitude of a sine at the frequency
+  for (size_t k = 0; k < count; k++) {
+    float power = s1[k] * s1[k] + s2[k] * s2[k] - coefficient[k] * s1[k] * s2[k];
+    float amplitude = sqrtf(std::max(power, 0.0f)) * scale;
+    s1[k] = 0;
+    s2[k] = 0;
+    if (!searching) {
+      detect(amplitude, start, position, text);
+    } else {
+      history.push_back(amplitude);
+    }
+  }
+  used = 0;
+
+  if (searching) {
+    // A keyed tone is one that is ten times stronger than it has been
+    for (size_t k = 0; k < count; k++) {
+      float amplitude = history[first + k];
+      if (!toneSeen && amplitude > silence && amplitude > 10 * quietest[k]) {
+        toneSeen = true;
+        toneSeenAt = blocks;
+      }
+      quietest[k] = std::min(quietest[k], amplitude);
+    }
+  }
+  blocks++;
+  if (searching && ((toneSeen && blocks - toneSeenAt >= searchBlocks) || blocks >= maxSearchBlocks)) {
+    endSearch(text);
+  }
+}
+
+void Listener::endSearch(std::string& text) {
+  size_t count = filterHz.size();
+  size_t searched = history.size() / count;
+
+  std::vector<double> energy(count, 0);
+  for (size_t b = 0; b < searched; b++) {
+    for (size_t k = 0; k < count; k++) {
+      float amplitude = history[b * count + k];
+      energy[k] += amplitude * amplitude;
+    }
+  }
+  size_t best = std::max_element(energy.begin(), energy.end()) - energy.begin();
+
+  // Fit a parabola through the best filter and its neighbours to put the
+  // pitch between them. A given pitch is the only filter, and stays put.
+  pitchHz = filterHz[best];
+  if (best > 0 && best + 1 < count) {
+    double before = energy[best - 1];
+    double peak = energy[best];
+    double after = energy[best + 1];
+    double curve = before - 2 * peak + after;
+    if (curve < 0) {
+      pitchHz += 0.5 * (before - after) / curve * (filterHz[best + 1] - filterHz[best]);
+    }
+  }
+
+  // Start the detector from the levels seen: the noise from the quieter
+  // half of the blocks, which in Morse are all gaps, and the signal from
+  // the loudest but a few. A recording that starts on a mark then keeps
+  // its first mark.
+  std::vector<float> levels(searched);
+  for (size_t b = 0; b < searched; b++) {
+    levels[b] = history[b * count + best];
+  }
+  if (searched > 0) {
+    std::sort(levels.begin(), levels.end());
+    double quiet = 0;
+    for (size_t b = 0; b < (searched + 1) / 2; b++) {
+      quiet += levels[b];
+    }
+    noise = (float)(quiet / ((searched + 1) / 2));
+    signal = levels[searched - 1 - searched / 20];
+  }
+
+  searching = false;
+  setFilters({ pitchHz });
+  for (size_t b = 0; b < searched; b++) {
+    detect(history[b * count + best], b * shortestBlock, (b + 1) * shortestBlock, text);
+  }
+  history.clear();
+  history.shrink_to_fit();
+  quietest.clear();
+}
+
+void Listener::detect(float amplitude, uint64_t start, uint64_t end, std::string& text) {
+  if (signal < 0) {
+    signal = amplitude;
+    noise = amplitude;
+  }
+
+  // No key at all unless the signal stands well clear of the noise
+  float span = signal - noise;
+  bool tone = span > noise + silence && amplitude > noise + span * (down ? 0.4f : 0.5f);
+  // How much of the block the tone filled, from where it sits between the
+  // levels: a block the key went down or up in is partly filled
+  float fill = span > 0 ? std::min(std::max((amplitude - noise) / span, 0.0f), 1.0f) : 0;
+
+  // Marks teach the signal level and gaps the noise level. Between marks
+  // the signal level sinks slowly towards the noise, so a fading signal is
+  // picked up again, and the noise level creeps up during marks, so a
+  // rising noise floor cannot hold the key down for good.
+  if (tone) {
+    signal += (amplitude - signal) * (amplitude > signal ? 0.5f : 0.25f);
+    noise += (amplitude - noise) * noiseRise;
+  } else {
+    if (amplitude < noise + span / 4) {
+      noise += (amplitude - noise) * 0.1f;  // Clearly a gap, not a missed mark
+    }
+    signal = noise + (signal - noise) * signalFall;
+  }
+  signal = std::max(signal, noise);
+
+  if (tone != down) {
+    if (run == 0) {
+      // The edge is in this block or the one before, which between them
+      // hold tone for edgeFill blocks' worth
+      runStart = start;
+      edgeFill = lastFill + fill;
+    }
+    if (++run >= holdBlocks) {
+      down = tone;
+      run = 0;
+      double length = (double)(end - start);
+      double at = runStart + (down ? 1 - edgeFill : edgeFill - 1) * length;
+      edgeAt = std::max(edgeAt, (uint64_t)std::max(at, 0.0));
+      addEdge(down, sampleUs(edgeAt), text);
+    }
+  } else {
+    run = 0;
+  }
+  lastFill = fill;
+
+  // Let characters out as soon as their gap is long enough, but not
+  // beyond the start of a mark still being confirmed
+  if (learned && !down) {
+    poll(sampleUs(run != 0 ? runStart : end), text);
+  }
+}
+
+void Listener::addEdge(bool keyDown, unsigned long us, std::string& text) {
+  Edge edge = { keyDown, us };
+  if (learned) {
+    decodeEdge(edge, text);
+    return;
+  }
+  held[heldCount++] = edge;
+  if (heldCount == learnEdges) {
+    learn(text);
+  }
+}
+
+void Listener::learn(std::string& text) {
+  // The shortest gap is the one inside a character, a dot long. The
+  // shortest mark is a dot too, unless every mark so far was a dash.
+  unsigned long shortestMark = ULONG_MAX;
+  unsigned long shortestGap = ULONG_MAX;
+  for (uint8_t i = 1; i < heldCount; i++) {
+    unsigned long length = held[i].us - held[i - 1].us;
+    unsigned long& shortest = held[i].down ? shortestGap : shortestMark;
+    shortest = std::min(shortest, length);
+  }
+  if (shortestMark != ULONG_MAX) {
+    unsigned long dotUs = shortestMark;
+    if (shortestGap != ULONG_MAX) {
+      if (dotUs > 2 * shortestGap) {
+        dotUs /= 3;
+      }
+      // A dot and the gap after it are two dots, however the detector
+      // splits them
+      dotUs = (dotUs + shortestGap) / 2;
+    }
+    decoder.reset((uint8_t)std::min(std::max(1200000UL / dotUs, 1UL), 255UL));
+  }
+
+  learned = true;
+  for (uint8_t i = 0; i < heldCount; i++) {
+    decodeEdge(held[i], text);
+  }
+}
+
+void Listener::decodeEdge(const Edge& edge, std::string& text) {
+  // A dot and the gap inside a character that follows it are keyed the
+  // same length, so half their difference is what the detector takes off
+  // every mark: the ramps of a shaped signal and the level it calls the
+  // key down at. Follow it, and give it back before the decoder, which
+  // learns the speed from the marks alone.
+  long dotUs = 1200000L / decoder.wpm();
+  if (edge.down && markEndUs > markStartUs) {
+    long mark = (long)(markEndUs - markStartUs);
+    long gap = (long)(edge.us - markEndUs);
+    if (mark < 2 * dotUs && gap < 2 * dotUs) {
+      markBiasUs += ((gap - mark) / 2 - markBiasUs) / 4;
+    }
+  }
+  (edge.down ? markStartUs : markEndUs) = edge.us;
+
+  long shift = std::min(std::max(markBiasUs, -dotUs / 2), dotUs / 2) / 2;
+  long shifted = (long)edge.us + (edge.down ? -shift : shift);
+  unsigned long us = std::max((unsigned long)std::max(shifted, 0L), lastEdgeUs);
+  lastEdgeUs = us;
+  poll(us, text);
+  decoder.edge(edge.down, us);
+
+  // Fit the block to the sender: about six to a dot, so marks and gaps are
+  // still timed closely, but each block hears as little noise as it can
+  size_t fit = (size_t)(rate * 1.2 / decoder.wpm() / 6);
+  fit = std::min(std::max(fit, shortestBlock), longestBlock);
+  if (fit * 4 > blockSamples * 5 || fit * 5 < blockSamples * 4) {
+    setBlock(fit);
+  }
+}
+
+void Listener::poll(unsigned long us, std::string& text) {
+  us = std::max(us, lastEdgeUs);  // The decoder's last edge may have been moved later
+  for (char c; (c = decoder.poll(us)) != 0; ) {
+    if (c == ' ') {
+      spacePending = true;
+      continue;
+    }
+    if (spacePending) {
+      text += ' ';
+      spacePending = false;
+    }
+    char utf[3];
+    text.append(utf, utf8Encode(morseToUnicode(c, decoder.alphabet), utf));
+  }
+}
+
+void Listener::finish(std::string& text) {
+  if (searching) {
+    endSearch(text);
+  }
+  if (down) {
+    down = false;
+    addEdge(false, sampleUs(position), text);
+  }
+  if (!learned) {
+    learn(text);
+  }
+  poll(sampleUs(position) + 60000000UL, text);  // Long enough to end any character
+  spacePending = false;
+}
+
+}  // namespace morse
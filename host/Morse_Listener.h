@@ -0,0 +1,194 @@
+/*
+   Decodes Morse from recorded audio: PCM samples in, text out.
+
+   WavReader streams 8-bit or 16-bit PCM from a WAV file a piece at a
+   time, mixed down to one channel and scaled to +-1.
+
+   Listener cuts the samples into blocks of a few milliseconds and runs a
+   Goertzel filter over each, which gives the strength of one frequency at
+   the cost of a multiply and two adds per sample. A longer block hears
+   less noise but blurs the edges of the marks more, so once the speed is
+   known each block is made about a sixth of a dot, between blockMs and
+   maxBlockMs, and follows the sender from then on. Until the pitch is
+   known, a bank of filters a quarter of a bin apart covers the whole
+   search range; once a keyed tone has shown up and searchMs of audio has
+   been seen, the filter with the most energy wins and the bank shrinks
+   to that one filter. The block strengths seen during the search are kept
+   and played back through the detector, so nothing before the pitch was
+   found is lost, and they give the detector its starting levels. A pitch
+   given in the settings skips the bank but not the wait.
+
+   The detector learns the signal level from the marks and the noise
+   level from the gaps, and calls the key down above half way between
+   them and up below two fifths, so it rides out fading and a changing
+   noise floor. A change of state has to last two blocks to count. Each
+   edge is then placed inside its block from how far the blocks either
+   side of it sit between the two levels, so its timing is finer than a
+   block.
+
+   A detected mark still comes out shorter than it was keyed, by the rise
+   and fall of a shaped signal and by where the key is called down and up;
+   at 60 wpm that is a good part of a 20 ms dot. A dot and the gap after
+   it inside a character are keyed the same length, so half their
+   difference as detected measures it. The listener follows that and
+   lengthens every mark by it before the edges go to the sketch's own
+   MorseDecoder, which sorts marks and gaps against a running estimate of
+   the dot length taken from the marks. Its first guess at the speed is
+   taken from the shortest marks and gaps among the first few edges,
+   which are held back until then.
+
+   Memory use does not depend on the length of the recording: the sample
+   buffer, the filter bank and the held back edges are all fixed in size,
+   and the search history is capped at maxSearchMs.
+*/
+
+#ifndef MORSE_LISTENER_H
+#define MORSE_LISTENER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../Morse_Decoder.h"
+
+namespace morse {
+
+class WavReader {
+public:
+  // Read the header from f, leaving it at the first sample. Returns false,
+  // with the reason in error, if f is not 8-bit or 16-bit PCM.
+  bool open(FILE* f, std::string& error);
+
+  // Read up to max samples into out. Returns the number read, 0 at the end.
+  size_t read(float* out, size_t max);
+
+  uint32_t sampleRate() const {
+    return rate;
+  }
+
+  // True if the file ended early or could not be read
+  bool failed() const {
+    return readFailed;
+  }
+
+private:
+  bool readExact(void* out, size_t n);
+
+  FILE* file = nullptr;
+  uint32_t rate = 0;
+  uint16_t channels = 0;
+  uint16_t bytesPerSample = 0;
+  uint64_t remaining = 0;  // Bytes of sample data still to read
+  bool readFailed = false;
+  std::vector<uint8_t> raw;
+};
+
+struct ListenSettings {
+  double pitchHz = 0;        // Tone to listen for, or 0 to search for it
+  double minPitchHz = 200;   // Search range
+  double maxPitchHz = 3000;
+  double blockMs = 4;        // Shortest detector block, used for the search
+  double maxBlockMs = 12;    // Longest, used for the slowest senders
+  double searchMs = 2000;    // Audio to search once a keyed tone shows up
+  double maxSearchMs = 30000;  // Give up waiting for one after this long
+};
+
+class Listener {
+public:
+  Listener(uint32_t sampleRate, const ListenSettings& settings);
+
+  // Feed the next n samples, appending whatever they complete to text as
+  // UTF-8. A word gap comes out as a space.
+  void feed(const float* samples, size_t n, std::string& text);
+
+  // The recording has ended: append the rest of the text
+  void finish(std::string& text);
+
+  // The pitch listened to, 0 if none was found
+  double pitch() const {
+    return searching ? 0 : pitchHz;
+  }
+
+  // The sender's speed as last estimated
+  uint8_t wpm() const {
+    return decoder.wpm();
+  }
+
+private:
+  static const uint8_t holdBlocks = 2;   // Blocks a new key state must last
+  static const uint8_t learnEdges = 24;  // Edges held back to guess the speed
+
+  struct Edge {
+    bool down;
+    unsigned long us;
+  };
+
+  void setBlock(size_t samples);
+  void setFilters(const std::vector<double>& hz);
+  void filter(const float* samples, size_t n);
+  void endBlock(std::string& text);
+  void endSearch(std::string& text);
+  void detect(float amplitude, uint64_t start, uint64_t end, std::string& text);
+  void addEdge(bool down, unsigned long us, std::string& text);
+  void learn(std::string& text);
+  void decodeEdge(const Edge& edge, std::string& text);
+  void poll(unsigned long us, std::string& text);
+
+  unsigned long sampleUs(uint64_t sample) const {
+    return (unsigned long)(sample * 1000000 / rate);
+  }
+
+  uint32_t rate;
+  ListenSettings settings;
+  size_t blockSamples;
+  size_t shortestBlock;
+  size_t longestBlock;
+
+  // Goertzel filter bank, one entry per frequency
+  std::vector<double> filterHz;
+  std::vector<float> coefficient;
+  std::vector<float> s1;
+  std::vector<float> s2;
+  size_t used = 0;        // Samples so far in the current block
+  uint64_t position = 0;  // Samples in the blocks completed
+  uint64_t blocks = 0;    // Blocks completed
+
+  // Pitch search
+  bool searching;
+  double pitchHz;
+  std::vector<float> history;  // Block amplitudes, filterHz.size() per block
+  std::vector<float> quietest;  // Weakest block so far at each frequency
+  uint64_t searchBlocks;
+  uint64_t maxSearchBlocks;
+  bool toneSeen = false;
+  uint64_t toneSeenAt = 0;  // Block at which a keyed tone showed up
+
+  // Detector
+  float signal = -1;  // Amplitudes; negative until the first block
+  float noise = 0;
+  float signalFall;   // Per block
+  float noiseRise;
+  bool down = false;  // Key state as decided
+  uint8_t run = 0;    // Blocks in a row that disagree with down
+  uint64_t runStart = 0;  // Sample at which they began
+  float lastFill = 0;     // Share of the last block the tone filled
+  float edgeFill = 0;     // Tone in the block before the run and its first
+  uint64_t edgeAt = 0;    // Sample of the last edge
+
+  // Timing
+  Edge held[learnEdges];
+  uint8_t heldCount = 0;
+  bool learned = false;
+  bool spacePending = false;  // A word ended; the space waits for another word
+  long markBiasUs = 0;  // How much shorter than keyed marks are detected
+  unsigned long markStartUs = 0;  // Edges as detected, before the bias
+  unsigned long markEndUs = 0;
+  unsigned long lastEdgeUs = 0;   // Last edge given to the decoder
+  MorseDecoder decoder;
+};
+
+}  // namespace morse
+
+#endif
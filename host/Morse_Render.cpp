@@ -0,0 +1,153 @@
+/*
+   Command line WAV renderer: text in, 16-bit mono PCM Morse audio out.
+
+   Build (from the repository root):
+     g++ -std=c++17 -O3 -I. host/Morse_Encoder.cpp host/Morse_Wav.cpp \
+         host/Morse_Render.cpp -o morse_render
+
+   Usage:
+     ./morse_render [options] [input]     input defaults to stdin
+
+     -o FILE     write the WAV to FILE instead of stdout
+     -r RATE     sample rate in Hz (default 8000)
+     -p HZ       tone pitch (default 700)
+     -w WPM      speed (default 20)
+     -e MS       rise and fall time of each mark (default 5)
+     -v LEVEL    peak level from 0 to 1 (default 0.8)
+     -a ALPHABET latin, cyrillic, greek or wabun (default latin): the
+                 code page UTF-8 input is keyed in, as with #alpha
+     -q          do not print the summary
+
+   A file input is memory mapped and measured first, so the WAV header
+   carries the exact length without seeking and the output can go straight
+   into a pipe. Stdin is rendered as it arrives, in fixed size reads, so
+   memory use does not grow with the input: the header goes out with the
+   length unknown (see wavUnknownLength) and is filled in afterwards if
+   the output is a file that can be seeked.
+*/
+
+#include "Morse_Encoder.h"
+#include "Morse_Wav.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+
+static void usage() {
+  fprintf(stderr, "usage: morse_render [-o file] [-r rate] [-p hz] [-w wpm] [-e ms] [-v level] [-a alphabet] [-q] [input]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  morse::RenderSettings settings;
+  const char* inputPath = nullptr;
+  const char* outputPath = nullptr;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "-o" && hasValue) {
+      outputPath = argv[++i];
+    } else if (arg == "-r" && hasValue) {
+      settings.sampleRate = (uint32_t)atoi(argv[++i]);
+    } else if (arg == "-p" && hasValue) {
+      settings.pitchHz = atof(argv[++i]);
+    } else if (arg == "-w" && hasValue) {
+      settings.wpm = atof(argv[++i]);
+    } else if (arg == "-e" && hasValue) {
+      settings.rampMs = atof(argv[++i]);
+    } else if (arg == "-v" && hasValue) {
+      settings.volume = atof(argv[++i]);
+    } else if (arg == "-a" && hasValue) {
+      settings.alphabet = morse::alphabetNamed(argv[++i]);
+      if (settings.alphabet == morseAlphabets) {
+        usage();
+      }
+    } else if (arg == "-q") {
+      quiet = true;
+    } else if (arg[0] == '-' && arg != "-") {
+      usage();
+    } else {
+      inputPath = arg == "-" ? nullptr : argv[i];
+    }
+  }
+  if (settings.sampleRate < 1000 || settings.wpm <= 0 || settings.pitchHz <= 0 ||
+      settings.pitchHz >= settings.sampleRate / 2.0 || settings.volume < 0 || settings.volume > 1) {
+    fprintf(stderr, "morse_render: settings out of range\n");
+    return 2;
+  }
+
+  morse::MappedFile file;
+  if (inputPath != nullptr && !file.open(inputPath)) {
+    fprintf(stderr, "morse_render: %s: %s\n", inputPath, strerror(errno));
+    return 1;
+  }
+
+  FILE* out = stdout;
+  if (outputPath != nullptr) {
+    out = fopen(outputPath, "wb");
+    if (out == nullptr) {
+      fprintf(stderr, "morse_render: %s: %s\n", outputPath, strerror(errno));
+      return 1;
+    }
+  }
+  static char outBuffer[1 << 20];
+  setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  morse::PcmRenderer renderer(settings);
+  uint64_t samples = 0;
+  bool ok = true;
+  auto write = [&](const int16_t* block, size_t n) {
+    // WAV is little-endian, as is every host this is expected to run on
+    ok = ok && fwrite(block, sizeof(int16_t), n, out) == n;
+    samples += n;
+  };
+
+  if (inputPath != nullptr) {
+    // A mapped file is read twice in place
+    std::string_view text = file.contents();
+    ok = morse::writeWavHeader(out, settings.sampleRate, renderer.countSamples(text));
+    renderer.render(text, write);
+  } else {
+    ok = morse::writeWavHeader(out, settings.sampleRate, morse::wavUnknownLength);
+    static char buffer[65536];
+    for (;;) {
+      ssize_t n = read(0, buffer, sizeof(buffer));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      renderer.render(std::string_view(buffer, n), write);
+    }
+  }
+  renderer.finish(write);
+  ok = fflush(out) == 0 && ok;
+  if (ok && inputPath == nullptr && fseek(out, 0, SEEK_SET) == 0) {
+    // Seekable after all, so give the real length
+    ok = morse::writeWavHeader(out, settings.sampleRate, samples) && fflush(out) == 0;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (!ok) {
+    fprintf(stderr, "morse_render: write failed: %s\n", strerror(errno));
+    return 1;
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  if (!quiet) {
+    double audioSeconds = (double)samples / settings.sampleRate;
+    fprintf(stderr, "%.1f s of audio (%llu samples) in %.3f s, %.0fx real time\n",
+            audioSeconds, (unsigned long long)samples, seconds, seconds > 0 ? audioSeconds / seconds : 0.0);
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Renders a test message with morse_render at every speed, pitch and
+# sample rate below, decodes each file with morse_listen, and checks that
+# the text comes back exactly and the speed within 1 wpm.
+#
+# Usage (from the repository root):
+#   host/Morse_Roundtrip.sh [-v]        -v prints every case, not just failures
+#
+# Needs a C++17 compiler as c++ (or set CXX). Exits non-zero if any case
+# fails.
+
+set -e
+
+verbose=${1:-}
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cxx=${CXX:-c++}
+
+speeds='5 10 15 20 30 40 50 60'
+pitches='550 700 1000 1800'
+rates='8000 16000 48000'
+text='PARIS THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG 0123456789 SMITH'
+
+"$cxx" -std=c++17 -O2 -I"$root" "$root/host/Morse_Encoder.cpp" "$root/host/Morse_Wav.cpp" \
+  "$root/host/Morse_Render.cpp" -o "$work/morse_render"
+"$cxx" -std=c++17 -O2 -pthread -I"$root" "$root/host/Morse_Listener.cpp" \
+  "$root/host/Morse_Listen.cpp" -o "$work/morse_listen"
+
+cases=0
+failed=0
+for wpm in $speeds; do
+  for pitch in $pitches; do
+    for rate in $rates; do
+      cases=$((cases + 1))
+      echo "$text" | "$work/morse_render" -q -w "$wpm" -p "$pitch" -r "$rate" -o "$work/case.wav"
+      got=$("$work/morse_listen" "$work/case.wav" 2> "$work/summary")
+      heard=$(sed -n 's/.*Hz, \([0-9]*\) wpm$/\1/p' "$work/summary")
+      case=$(printf '%2s wpm %4s Hz %5s Hz' "$wpm" "$pitch" "$rate")
+      if [ "$got" != "$text" ] || [ -z "$heard" ] || [ "$heard" -lt $((wpm - 1)) ] || [ "$heard" -gt $((wpm + 1)) ]; then
+        failed=$((failed + 1))
+        echo "FAIL $case: heard ${heard:-?} wpm: $got"
+      elif [ "$verbose" = -v ]; then
+        echo "ok   $case: heard $heard wpm"
+      fi
+    done
+  done
+done
+
+echo "$((cases - failed)) of $cases round trips decoded exactly"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,283 @@
+/*
+   Runs a sketch's setup()/loop() on the virtual clock and reports what it did.
+
+   Build (from the repository root):
+     g++ -std=c++17 -O2 -I. -x c++ Morse_Convertor_rev4.c -x none \
+         host/Morse_HAL_Host.cpp host/Morse_Sim.cpp -o morse_sim
+
+   Add -DMORSE_TRACE=1 to build the sketch with tracing for --trace, and
+   any other switch from Morse_Config.h to simulate that configuration.
+   host/Morse_Check.sh builds it that way and runs it on fixed inputs as
+   a regression check.
+
+   Usage:
+     ./morse_sim [options] [text...]     text defaults to stdin
+
+     --events          print every recorded event as CSV
+     --serial          print everything the sketch sent over Serial
+     --trace           send #trace once the run is over and print the reply
+     --no-flow         make the sender ignore XON/XOFF
+     --loop-us N       virtual time one pass of loop() takes (default 20)
+     --idle-ms N       stop once nothing happened for N ms (default 3000)
+     --max-s N         stop after N virtual seconds (default 3600)
+     --key TEXT        also key TEXT onto the key input pin, for #rx
+     --key-wpm N       speed to key it at (default 20)
+     --key-jitter N    vary each element length by up to N percent
+     --key-pin N       input pin to drive (default 7)
+     --wav FILE        write the sidetone on pin 3 as an 8-bit WAV file
+     --eeprom FILE     load the EEPROM from FILE, if it exists, and save it
+                       back after the run, so slots saved with #save
+                       survive to the next run as they would a power cycle
+*/
+
+#include "../Morse_HAL.h"
+#include "../Morse_Table.h"
+#include "../Morse_Timing.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+
+void setup();
+void loop();
+
+static const uint32_t wavRateHz = 31250;  // The host sidetone's sample rate
+
+// Write the PWM levels recorded by sim::audioSample() as 8-bit mono PCM,
+// holding each level until the next, from time 0 to endUs
+static bool writeWav(const char* path, uint64_t endUs) {
+  FILE* f = fopen(path, "wb");
+  if (f == NULL) {
+    return false;
+  }
+  const std::vector<sim::AudioSample>& audio = sim::audio();
+  uint32_t samples = (uint32_t)(endUs * wavRateHz / 1000000);
+  uint8_t header[44] = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+                         16, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 8, 0,
+                         'd', 'a', 't', 'a', 0, 0, 0, 0 };
+  uint32_t fields[4][2] = { { 4, 36 + samples }, { 24, wavRateHz }, { 28, wavRateHz }, { 40, samples } };
+  for (int i = 0; i < 4; i++) {
+    for (int b = 0; b < 4; b++) {
+      header[fields[i][0] + b] = (uint8_t)(fields[i][1] >> (8 * b));
+    }
+  }
+  fwrite(header, 1, sizeof(header), f);
+  uint8_t level = 128;
+  size_t next = 0;
+  for (uint32_t i = 0; i < samples; i++) {
+    uint64_t us = (uint64_t)i * 1000000 / wavRateHz;
+    for (; next < audio.size() && audio[next].us <= us; next++) {
+      level = audio[next].level;
+    }
+    fputc(level, f);
+  }
+  return fclose(f) == 0;
+}
+
+// Time the sidetone sounded and its pitch, from the rising crossings of
+// the midpoint while the sample interrupt ran
+static void printSidetone() {
+  const std::vector<sim::AudioSample>& audio = sim::audio();
+  uint64_t runningUs = 0;
+  uint32_t crossings = 0;
+  int peak = 0;
+  for (size_t i = 1; i < audio.size(); i++) {
+    uint64_t gap = audio[i].us - audio[i - 1].us;
+    if (gap <= 1000000 / wavRateHz) {
+      runningUs += gap;
+      crossings += audio[i - 1].level < 128 && audio[i].level >= 128;
+    }
+    peak = std::max(peak, abs(audio[i].level - 128));
+  }
+  fprintf(stderr, "sidetone:      %.3f s, %.1f Hz, peak %d/127\n", runningUs / 1e6,
+          runningUs > 0 ? crossings * 1e6 / runningUs : 0.0, peak);
+}
+
+// Schedule the key edges for text on pin, active low, starting at startUs
+static void scheduleKeying(uint8_t pin, const std::string& text, uint8_t wpm, int jitterPct, uint64_t startUs) {
+  MorseTiming timing = morseTiming(wpm);
+  uint64_t t = startUs;
+  srand(1);
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == ' ') {
+      t += (timing.wordGap - timing.letterGap) * 1000ULL;
+      continue;
+    }
+    uint8_t code = morseEncode(text[i]);
+    if (code == morseInvalid) {
+      continue;
+    }
+    for (uint8_t element = morseFirstElement(code); element != 0; element >>= 1) {
+      uint32_t mark = ((code & element) ? timing.dash : timing.dot) * 1000UL;
+      uint32_t space = (element == 1 ? timing.letterGap : timing.elementGap) * 1000UL;
+      if (jitterPct > 0) {
+        mark += (long)mark * (rand() % (2 * jitterPct + 1) - jitterPct) / 100;
+        space += (long)space * (rand() % (2 * jitterPct + 1) - jitterPct) / 100;
+      }
+      sim::pinInput(pin, LOW, t);
+      t += mark;
+      sim::pinInput(pin, HIGH, t);
+      t += space;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  bool printEvents = false;
+  bool printSerial = false;
+  bool printTrace = false;
+  bool flowControl = true;
+  uint32_t loopUs = 20;
+  uint64_t idleUs = 3000000;
+  uint64_t maxUs = 3600000000ULL;
+  std::string text;
+  std::string keyText;
+  uint8_t keyWpm = 20;
+  int keyJitter = 0;
+  uint8_t keyPin = 7;
+  std::string eepromFile;
+  std::string wavFile;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--events") {
+      printEvents = true;
+    } else if (arg == "--serial") {
+      printSerial = true;
+    } else if (arg == "--trace") {
+      printTrace = true;
+    } else if (arg == "--no-flow") {
+      flowControl = false;
+    } else if (arg == "--loop-us" && i + 1 < argc) {
+      loopUs = (uint32_t)atol(argv[++i]);
+    } else if (arg == "--idle-ms" && i + 1 < argc) {
+      idleUs = atoll(argv[++i]) * 1000ULL;
+    } else if (arg == "--max-s" && i + 1 < argc) {
+      maxUs = atoll(argv[++i]) * 1000000ULL;
+    } else if (arg == "--key" && i + 1 < argc) {
+      keyText = argv[++i];
+    } else if (arg == "--key-wpm" && i + 1 < argc) {
+      keyWpm = (uint8_t)atoi(argv[++i]);
+    } else if (arg == "--key-jitter" && i + 1 < argc) {
+      keyJitter = atoi(argv[++i]);
+    } else if (arg == "--key-pin" && i + 1 < argc) {
+      keyPin = (uint8_t)atoi(argv[++i]);
+    } else if (arg == "--wav" && i + 1 < argc) {
+      wavFile = argv[++i];
+    } else if (arg == "--eeprom" && i + 1 < argc) {
+      eepromFile = argv[++i];
+    } else {
+      if (!text.empty()) {
+        text += ' ';
+      }
+      text += arg;
+    }
+  }
+  if (text.empty()) {
+    text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+  } else {
+    text += '\n';
+  }
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+  if (!eepromFile.empty()) {
+    FILE* f = fopen(eepromFile.c_str(), "rb");
+    if (f != NULL) {
+      fread(sim::eeprom(), 1, E2END + 1, f);
+      fclose(f);
+    }
+  }
+
+  sim::reset();
+  sim::serialFlowControl(flowControl);
+  setup();
+  sim::serialFeed(text.data(), text.size(), sim::now());
+  if (!keyText.empty()) {
+    // Start keying once the text above has had time to arrive
+    scheduleKeying(keyPin, keyText, keyWpm, keyJitter, sim::now() + text.size() * 1100 + 500000);
+  }
+
+  // Keep calling loop() until the input is used up and the sketch has
+  // gone quiet, ignoring bytes that merely arrive on the RX line
+  uint64_t lastActivity = sim::now();
+  size_t seen = sim::events.size();
+  uint64_t passes = 0;
+  while (sim::now() < maxUs) {
+    loop();
+    sim::advance(loopUs);
+    passes++;
+
+    for (; seen < sim::events.size(); seen++) {
+      if (sim::events[seen].kind != sim::EV_SERIAL_RX) {
+        lastActivity = sim::events[seen].us;
+      }
+    }
+    if (sim::serialPending() == 0 && sim::now() - lastActivity > idleUs) {
+      break;
+    }
+  }
+
+  size_t traceStart = sim::serialOutput().size();
+  if (printTrace) {
+    // Run until the dump has been sent and the line has gone quiet
+    const char command[] = "#trace\n";
+    sim::serialFeed(command, sizeof(command) - 1, sim::now());
+    size_t sent;
+    do {
+      sent = sim::serialOutput().size();
+      for (int i = 0; i < 1000; i++) {
+        loop();
+        sim::advance(loopUs);
+      }
+    } while (sim::serialPending() > 0 || sim::serialOutput().size() != sent);
+  }
+
+  if (!eepromFile.empty()) {
+    FILE* f = fopen(eepromFile.c_str(), "wb");
+    if (f == NULL || fwrite(sim::eeprom(), 1, E2END + 1, f) != E2END + 1) {
+      fprintf(stderr, "morse_sim: cannot write %s\n", eepromFile.c_str());
+      return 1;
+    }
+    fclose(f);
+  }
+
+  if (!wavFile.empty() && !writeWav(wavFile.c_str(), sim::now())) {
+    fprintf(stderr, "morse_sim: cannot write %s\n", wavFile.c_str());
+    return 1;
+  }
+
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+
+  if (printEvents) {
+    printf("us,event,pin,value\n");
+    for (size_t i = 0; i < sim::events.size(); i++) {
+      const sim::Event& e = sim::events[i];
+      printf("%llu,%s,%u,%d\n", (unsigned long long)e.us, sim::eventName(e.kind), e.pin, e.value);
+    }
+  }
+
+  if (printSerial) {
+    fwrite(sim::serialOutput().data(), 1, traceStart, stdout);
+  }
+
+  if (printTrace) {
+    fwrite(sim::serialOutput().data() + traceStart, 1, sim::serialOutput().size() - traceStart, stdout);
+  }
+
+  fprintf(stderr, "virtual time:  %.3f s\n", lastActivity / 1e6);
+  fprintf(stderr, "wall time:     %.3f ms\n", wallMs);
+  fprintf(stderr, "loop passes:   %llu\n", (unsigned long long)passes);
+  // Sketches built without MORSE_SLEEP never sleep and show 0%
+  fprintf(stderr, "asleep:        %.3f s of %.3f s (%.1f%%)\n", sim::asleepUs() / 1e6, sim::now() / 1e6,
+          sim::now() > 0 ? 100.0 * sim::asleepUs() / sim::now() : 0.0);
+  fprintf(stderr, "events:        %zu\n", sim::events.size());
+  printSidetone();
+  fprintf(stderr, "rx dropped:    %u\n", sim::serialDropped());
+  fprintf(stderr, "rx paused:     %.3f s\n", sim::serialPausedUs() / 1e6);
+  fprintf(stderr, "lcd row 0:     [%s]\n", sim::lcdRow(0).c_str());
+  fprintf(stderr, "lcd row 1:     [%s]\n", sim::lcdRow(1).c_str());
+  return 0;
+}
@@ -0,0 +1,124 @@
+/*
+   Oscillator, envelope and WAV header behind Morse_Wav.h.
+*/
+
+#include "Morse_Wav.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace morse {
+
+PcmRenderer::PcmRenderer(const RenderSettings& settings)
+  : sine(1 << tableBits), oscillator(blockSamples), envelope(blockSamples), block(blockSamples),
+    alphabet(settings.alphabet) {
+  for (size_t i = 0; i < sine.size(); i++) {
+    sine[i] = (float)sin(2 * M_PI * i / sine.size());
+  }
+
+  unitSamples = settings.sampleRate * 1.2 / settings.wpm;
+
+  // A ramp longer than half a dot would never reach full volume
+  size_t rampSamples = (size_t)(settings.rampMs * settings.sampleRate / 1000);
+  if (rampSamples > unitSamples / 2) {
+    rampSamples = (size_t)(unitSamples / 2);
+  }
+  ramp.resize(rampSamples);
+  for (size_t i = 0; i < rampSamples; i++) {
+    ramp[i] = (float)(0.5 - 0.5 * cos(M_PI * (i + 0.5) / rampSamples));
+  }
+
+  phaseStep = (uint32_t)(settings.pitchHz / settings.sampleRate * 4294967296.0);
+  gain = (float)(settings.volume * 32767);
+}
+
+uint64_t PcmRenderer::countSamples(std::string_view text) const {
+  uint64_t total = units;
+  Utf8Decoder counting = utf8;
+  forEachElement(text, alphabet, counting, [&](Element e) { total += e.units; });
+  return sampleAt(total) - sampleAt(units);
+}
+
+// offset is where this run starts within a mark of length samples
+void PcmRenderer::renderTone(int16_t* out, size_t n, uint64_t offset, uint64_t length) {
+  float* osc = oscillator.data();
+  float* env = envelope.data();
+  const float* table = sine.data();
+  const int shift = 32 - tableBits;
+
+  // Oscillator: phase accumulator indexing the sine table
+  uint32_t p = phase;
+  for (size_t i = 0; i < n; i++) {
+    osc[i] = table[(p + (uint32_t)i * phaseStep) >> shift];
+  }
+  phase = p + (uint32_t)n * phaseStep;
+
+  // Envelope: the rise ramp, full gain, then the fall ramp, each clipped
+  // to the part of the mark this run covers
+  uint64_t r = ramp.size();
+  size_t riseEnd = offset < r ? (size_t)std::min<uint64_t>(n, r - offset) : 0;
+  size_t fallStart = offset + r < length ? (size_t)std::min<uint64_t>(n, length - r - offset) : 0;
+  if (fallStart < riseEnd) {
+    fallStart = riseEnd;
+  }
+  const float* rise = ramp.data();
+  for (size_t i = 0; i < riseEnd; i++) {
+    env[i] = gain * rise[offset + i];
+  }
+  for (size_t i = riseEnd; i < fallStart; i++) {
+    env[i] = gain;
+  }
+  const float* fall = ramp.data();
+  uint64_t last = length - 1 - offset;  // Fall is the rise played backwards
+  for (size_t i = fallStart; i < n; i++) {
+    env[i] = gain * fall[last - i];
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    out[i] = (int16_t)lrintf(osc[i] * env[i]);
+  }
+}
+
+void PcmRenderer::renderSilence(int16_t* out, size_t n) {
+  memset(out, 0, n * sizeof(int16_t));
+  phase += (uint32_t)n * phaseStep;  // Keep the oscillator running
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  put16(p, v & 0xFFFF);
+  put16(p + 2, v >> 16);
+}
+
+bool writeWavHeader(FILE* f, uint32_t sampleRate, uint64_t samples) {
+  uint64_t dataBytes = samples * 2;
+  uint32_t riffBytes = (uint32_t)(36 + dataBytes);
+  if (samples == wavUnknownLength) {
+    dataBytes = 0xFFFFFFFFULL;
+    riffBytes = 0xFFFFFFFF;
+  } else if (dataBytes > 0xFFFFFFFFULL - 36) {
+    dataBytes = 0xFFFFFFFFULL - 36;  // WAV sizes are 32 bits; clamp, as most tools do
+    riffBytes = 0xFFFFFFFF;
+  }
+  uint8_t h[44];
+  memcpy(h, "RIFF", 4);
+  put32(h + 4, riffBytes);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put32(h + 16, 16);             // fmt chunk size
+  put16(h + 20, 1);              // PCM
+  put16(h + 22, 1);              // Mono
+  put32(h + 24, sampleRate);
+  put32(h + 28, sampleRate * 2);  // Bytes per second
+  put16(h + 32, 2);              // Bytes per frame
+  put16(h + 34, 16);             // Bits per sample
+  memcpy(h + 36, "data", 4);
+  put32(h + 40, (uint32_t)dataBytes);
+  return fwrite(h, 1, sizeof(h), f) == sizeof(h);
+}
+
+}  // namespace morse
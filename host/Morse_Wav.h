@@ -0,0 +1,124 @@
+/*
+   Renders encoded Morse to 16-bit mono PCM, and writes it as a WAV file.
+
+   The tone comes from a phase accumulator stepping through a sine table,
+   so the pitch is exact and the phase runs on unbroken from one mark to
+   the next. Each mark fades in and out along a raised cosine ramp instead
+   of switching hard, which is what makes a plain square wave click.
+   Output is produced in fixed blocks of blockSamples, so memory use does
+   not depend on the length of the message; the per-sample work is two
+   simple array loops that the compiler can vectorise.
+*/
+
+#ifndef MORSE_WAV_H
+#define MORSE_WAV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string_view>
+#include <vector>
+
+#include "Morse_Encoder.h"
+
+namespace morse {
+
+struct RenderSettings {
+  uint32_t sampleRate = 8000;
+  double pitchHz = 700;
+  double wpm = 20;
+  double rampMs = 5;     // Rise and fall time of each mark
+  double volume = 0.8;   // Peak level, 1.0 is full scale
+  uint8_t alphabet = MORSE_LATIN;  // Code page the UTF-8 text is keyed in
+};
+
+class PcmRenderer {
+public:
+  static const size_t blockSamples = 4096;
+
+  explicit PcmRenderer(const RenderSettings& settings);
+
+  // Total samples text renders to, found without rendering it
+  uint64_t countSamples(std::string_view text) const;
+
+  // Render UTF-8 text, calling write(const int16_t* samples, size_t
+  // count) for every block. Calls can be repeated to render text in
+  // pieces, which may split a character.
+  template <typename Write>
+  void render(std::string_view text, Write&& write) {
+    forEachElement(text, alphabet, utf8, [&](Element e) {
+      uint64_t start = sampleAt(units);
+      units += e.units;
+      emit(e.on, sampleAt(units) - start, write);
+    });
+  }
+
+  // Render whatever is left in the current block
+  template <typename Write>
+  void finish(Write&& write) {
+    if (used > 0) {
+      write(block.data(), used);
+      used = 0;
+    }
+  }
+
+private:
+  // Sample index at which the element starting units into the stream
+  // begins; rounding each boundary keeps long messages from drifting
+  uint64_t sampleAt(uint64_t unitCount) const {
+    return (uint64_t)(unitCount * unitSamples + 0.5);
+  }
+
+  template <typename Write>
+  void emit(bool on, uint64_t count, Write& write) {
+    uint64_t pos = 0;
+    while (pos < count) {
+      size_t n = blockSamples - used;
+      if (count - pos < n) {
+        n = (size_t)(count - pos);
+      }
+      if (on) {
+        renderTone(block.data() + used, n, pos, count);
+      } else {
+        renderSilence(block.data() + used, n);
+      }
+      used += n;
+      pos += n;
+      if (used == blockSamples) {
+        write(block.data(), used);
+        used = 0;
+      }
+    }
+  }
+
+  void renderTone(int16_t* out, size_t n, uint64_t offset, uint64_t length);
+  void renderSilence(int16_t* out, size_t n);
+
+  static const int tableBits = 10;
+  std::vector<float> sine;      // One cycle, 1 << tableBits entries
+  std::vector<float> ramp;      // Raised cosine from 0 up to 1
+  std::vector<float> oscillator;  // Scratch for one block
+  std::vector<float> envelope;    // Scratch for one block
+  std::vector<int16_t> block;
+  size_t used = 0;
+
+  double unitSamples;
+  uint32_t phase = 0;
+  uint32_t phaseStep;
+  float gain;
+  uint64_t units = 0;  // Units rendered so far
+  uint8_t alphabet;
+  Utf8Decoder utf8;
+};
+
+// Length to give writeWavHeader() for a stream whose end is not known
+// yet: both chunk sizes are written as 0xFFFFFFFF, which most readers,
+// morse_listen among them, take as "read to the end of the file"
+const uint64_t wavUnknownLength = UINT64_MAX;
+
+// Write a 44 byte header for 16-bit mono PCM of the given length
+bool writeWavHeader(FILE* f, uint32_t sampleRate, uint64_t samples);
+
+}  // namespace morse
+
+#endif